@@ -1,520 +1,1300 @@
 #include <stdint.h>
+#include <stddef.h>
 #include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
 
 #include "Chip8.h"
 
-void Operation_8xy(Chip8State* state, uint8_t regx, uint8_t regy, uint8_t lownib);
-void Operation_Ex(Chip8State* state, uint8_t regx, uint8_t lowbyte);
-void Operation_Fx(Chip8State* state, uint8_t regx, uint8_t lowbyte);
+// Instruction dispatch can be selected at build time:
+//	CHIP8_DISPATCH_SWITCH	decode the opcode nibble by nibble (reference implementation)
+//	CHIP8_DISPATCH_TABLE	call through a pre-decoded table indexed by the full 16-bit opcode
+//	CHIP8_DISPATCH_GOTO	jump between handlers with GCC computed gotos (threaded code)
+// all three share the same operation bodies, so they only differ in how they get there
+#if !defined(CHIP8_DISPATCH_SWITCH) && !defined(CHIP8_DISPATCH_TABLE) && !defined(CHIP8_DISPATCH_GOTO)
+#define CHIP8_DISPATCH_SWITCH
+#endif
+
+#if defined(CHIP8_DISPATCH_GOTO) && !defined(__GNUC__)
+#error "CHIP8_DISPATCH_GOTO needs the GCC 'labels as values' extension"
+#endif
+
+typedef struct Chip8Instr Chip8Instr;
+typedef void (*Chip8Handler)(Chip8State* state, const Chip8Instr* in);
+
+// an opcode with all of its operand fields already pulled apart
+struct Chip8Instr
+{
+	uint16_t nnn; // 12-bit address
+	uint8_t x; // register in the low nibble of the first byte
+	uint8_t y; // register in the high nibble of the second byte
+	uint8_t kk; // second byte
+	uint8_t n; // low nibble of the second byte
+	uint8_t kind; // which operation this is (index into a core's label or handler table)
+	uint8_t len; // size in bytes, 0 marks an empty decode cache slot
+};
+
+// every operation the interpreter knows about, in no particular order
+#define CHIP8_OPERATIONS(OP) \
+	OP(Invalid) OP(Cls) OP(Ret) OP(Jp) OP(Call) OP(SeByte) OP(SneByte) OP(SeReg) \
+	OP(LdByte) OP(AddByte) OP(LdReg) OP(Or) OP(And) OP(Xor) OP(AddReg) OP(Sub) \
+	OP(Shr) OP(Subn) OP(Shl) OP(SneReg) OP(LdI) OP(JpV0) OP(Rnd) OP(Drw) \
+	OP(Skp) OP(Sknp) OP(LdVxDt) OP(LdVxK) OP(LdDtVx) OP(LdStVx) OP(AddI) OP(LdF) \
+	OP(LdB) OP(LdMemVx) OP(LdVxMem) \
+	OP(ScrollDown) OP(ScrollRight) OP(ScrollLeft) OP(Exit) OP(Lores) OP(Hires) OP(LdHf) OP(LdRVx) \
+	OP(LdVxR)
+
+enum
+{
+#define OP_KIND(name) KIND_##name,
+	CHIP8_OPERATIONS(OP_KIND)
+#undef OP_KIND
+	KIND_COUNT
+};
+
+_Static_assert(KIND_COUNT == CHIP8_OPERATION_CLASSES, "CHIP8_OPERATION_CLASSES is out of date");
+_Static_assert(offsetof(Chip8State, cycles) + sizeof(uint64_t) <= 64, "the hot registers have outgrown the first cache line");
+
+// operations that depend on a quirk are always inlined: every core (Chip8Core.h) gets
+// its own copy, and with the core's quirks a constant the checks fold away
+#define QUIRK_INLINE static inline __attribute__((always_inline))
+
+QUIRK_INLINE void Operation_8xy(Chip8State* state, const Chip8Instr* in, uint8_t quirks);
+static inline void Operation_Ex(Chip8State* state, const Chip8Instr* in, uint8_t quirks);
+QUIRK_INLINE void Operation_Fx(Chip8State* state, const Chip8Instr* in, uint8_t quirks);
 void Operation_NotImplemented(Chip8State* state);
 
+static void DecodeInstruction(uint16_t opcode, Chip8Instr* in);
+static void BuildDecodeTable(void);
+static void DrawSchipClipped(Chip8State* state, const Chip8Instr* in);
+static void DrawSchipWrapped(Chip8State* state, const Chip8Instr* in);
+
+static Chip8Instr decode_table[0x10000]; // one pre-decoded entry for every possible opcode
+static pthread_once_t decode_table_once = PTHREAD_ONCE_INIT; // states can be created from any thread
+
+// built-in hex digit sprites (0..F), 5 bytes each, loaded at 0x000
+static const uint8_t font[16 * 5] =
+{
+	0xf0, 0x90, 0x90, 0x90, 0xf0, // 0
+	0x20, 0x60, 0x20, 0x20, 0x70, // 1
+	0xf0, 0x10, 0xf0, 0x80, 0xf0, // 2
+	0xf0, 0x10, 0xf0, 0x10, 0xf0, // 3
+	0x90, 0x90, 0xf0, 0x10, 0x10, // 4
+	0xf0, 0x80, 0xf0, 0x10, 0xf0, // 5
+	0xf0, 0x80, 0xf0, 0x90, 0xf0, // 6
+	0xf0, 0x10, 0x20, 0x40, 0x40, // 7
+	0xf0, 0x90, 0xf0, 0x90, 0xf0, // 8
+	0xf0, 0x90, 0xf0, 0x10, 0xf0, // 9
+	0xf0, 0x90, 0xf0, 0x90, 0x90, // A
+	0xe0, 0x90, 0xe0, 0x90, 0xe0, // B
+	0xf0, 0x80, 0x80, 0x80, 0xf0, // C
+	0xe0, 0x90, 0x90, 0x90, 0xe0, // D
+	0xf0, 0x80, 0xf0, 0x80, 0xf0, // E
+	0xf0, 0x80, 0xf0, 0x80, 0x80, // F
+};
+
+// SUPER-CHIP 8x10 hex digits for Fx30, only put in memory when CHIP8_QUIRK_SCHIP is
+// turned on so plain chip-8 memory (and every hash of it) stays as it was
+#define BIG_FONT_ADDR 0x050
+static const uint8_t big_font[16 * 10] =
+{
+	0xff, 0xff, 0xc3, 0xc3, 0xc3, 0xc3, 0xc3, 0xc3, 0xff, 0xff, // 0
+	0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xff, 0xff, // 1
+	0xff, 0xff, 0x03, 0x03, 0xff, 0xff, 0xc0, 0xc0, 0xff, 0xff, // 2
+	0xff, 0xff, 0x03, 0x03, 0xff, 0xff, 0x03, 0x03, 0xff, 0xff, // 3
+	0xc3, 0xc3, 0xc3, 0xc3, 0xff, 0xff, 0x03, 0x03, 0x03, 0x03, // 4
+	0xff, 0xff, 0xc0, 0xc0, 0xff, 0xff, 0x03, 0x03, 0xff, 0xff, // 5
+	0xff, 0xff, 0xc0, 0xc0, 0xff, 0xff, 0xc3, 0xc3, 0xff, 0xff, // 6
+	0xff, 0xff, 0x03, 0x03, 0x06, 0x0c, 0x18, 0x18, 0x18, 0x18, // 7
+	0xff, 0xff, 0xc3, 0xc3, 0xff, 0xff, 0xc3, 0xc3, 0xff, 0xff, // 8
+	0xff, 0xff, 0xc3, 0xc3, 0xff, 0xff, 0x03, 0x03, 0xff, 0xff, // 9
+	0x7e, 0xff, 0xc3, 0xc3, 0xc3, 0xff, 0xff, 0xc3, 0xc3, 0xc3, // A
+	0xfc, 0xfc, 0xc3, 0xc3, 0xfc, 0xfc, 0xc3, 0xc3, 0xfc, 0xfc, // B
+	0x3c, 0xff, 0xc3, 0xc0, 0xc0, 0xc0, 0xc0, 0xc3, 0xff, 0x3c, // C
+	0xfc, 0xfe, 0xc3, 0xc3, 0xc3, 0xc3, 0xc3, 0xc3, 0xfe, 0xfc, // D
+	0xff, 0xff, 0xc0, 0xc0, 0xff, 0xff, 0xc0, 0xc0, 0xff, 0xff, // E
+	0xff, 0xff, 0xc0, 0xc0, 0xff, 0xff, 0xc0, 0xc0, 0xc0, 0xc0, // F
+};
+
 Chip8State* InitChip8(void)
 {
-	Chip8State* state = calloc(sizeof(Chip8State), 1); // using calloc since it initializes to 0's
-	
-	state->memory = calloc(1024 * 4, 1); // chip-8 has 4kb of memory available to it (0x000..0xfff)
-	state->display = state->memory + 0xf00; // display reserves 0xf00 - 0xfff
+	Chip8State* state = aligned_alloc(64, sizeof(Chip8State)); // sizeof is a multiple of the alignment
+	InitChip8At(state);
+	return state;
+}
+
+void InitChip8At(Chip8State* state)
+{
+	pthread_once(&decode_table_once, BuildDecodeTable);
+
+	memset(state, 0, sizeof(Chip8State)); // memory and display start out blank too
 	state->PC = 0x200; // memory below 0x200 is reserved
 	state->SP = 0; // 0xea0 - 0xeff is reserved for call stack and other variables
 	state->waiting_for_key_press = 0x0; // emulator-specific flag for 'wait for key press' instruction
+	SeedChip8Random(state, 1);
 
-	return state;
+	uint8_t i;
+	for (i = 0; i < sizeof(font); i++) // interpreter area holds the font
+	{
+		state->memory[i] = font[i];
+	}
+}
+
+void ResetChip8(Chip8State* state, const Chip8State* from)
+{
+	Chip8Instr* cache = state->decode_cache;
+	memcpy(state, from, sizeof(Chip8State));
+	state->decode_cache = cache;
+	if (cache)
+	{
+		memset(cache, 0, 0x1000 / 2 * sizeof(Chip8Instr)); // every slot empty, as EnableChip8DecodeCache leaves it
+	}
+}
+
+uint64_t HashChip8State(const Chip8State* state)
+{
+	// FNV-1a over everything a ROM can observe
+	uint64_t hash = 0xcbf29ce484222325ULL;
+#define HASH_BYTES(p, n) \
+	do { \
+		const uint8_t* b = (const uint8_t*)(p); \
+		size_t k; \
+		for (k = 0; k < (n); k++) { hash = (hash ^ b[k]) * 0x100000001b3ULL; } \
+	} while (0)
+
+	HASH_BYTES(state->memory, CHIP8_MEMORY_SIZE);
+	HASH_BYTES(state->display, sizeof(state->display));
+	HASH_BYTES(state->V, sizeof(state->V));
+	HASH_BYTES(&state->I, sizeof(state->I));
+	HASH_BYTES(&state->PC, sizeof(state->PC));
+	HASH_BYTES(&state->SP, 1);
+	HASH_BYTES(&state->DT, 1);
+	HASH_BYTES(&state->ST, 1);
+	if (state->quirks & CHIP8_QUIRK_SCHIP) // left out otherwise, so plain chip-8 hashes don't change
+	{
+		HASH_BYTES(&state->hires, 1);
+		HASH_BYTES(state->hires_display, sizeof(state->hires_display));
+		HASH_BYTES(state->rpl, sizeof(state->rpl));
+	}
+#undef HASH_BYTES
+	return hash;
+}
+
+// xxHash64-style mixing, a word at a time
+#define HASH_PRIME1 0x9e3779b185ebca87ULL
+#define HASH_PRIME2 0xc2b2ae3d27d4eb4fULL
+#define HASH_PRIME3 0x165667b19e3779f9ULL
+
+static inline uint64_t RotateLeft(uint64_t v, int bits)
+{
+	return (v << bits) | (v >> (64 - bits));
+}
+
+static inline uint64_t HashRound(uint64_t acc, uint64_t v)
+{
+	return RotateLeft(acc + v * HASH_PRIME2, 31) * HASH_PRIME1;
+}
+
+uint64_t HashChip8Frame(const Chip8State* state)
+{
+	// four independent lanes over the display rows so the multiplies overlap
+	uint64_t acc[4] = { HASH_PRIME1 + HASH_PRIME2, HASH_PRIME2, 0, -HASH_PRIME1 };
+	uint32_t row;
+	for (row = 0; row < CHIP8_DISPLAY_HEIGHT; row += 4)
+	{
+		acc[0] = HashRound(acc[0], state->display[row]);
+		acc[1] = HashRound(acc[1], state->display[row + 1]);
+		acc[2] = HashRound(acc[2], state->display[row + 2]);
+		acc[3] = HashRound(acc[3], state->display[row + 3]);
+	}
+	if (state->hires) // the lores display is blank then, but plain chip-8 never gets here
+	{
+		for (row = 0; row < CHIP8_HIRES_HEIGHT; row += 2)
+		{
+			acc[0] = HashRound(acc[0], state->hires_display[row][0]);
+			acc[1] = HashRound(acc[1], state->hires_display[row][1]);
+			acc[2] = HashRound(acc[2], state->hires_display[row + 1][0]);
+			acc[3] = HashRound(acc[3], state->hires_display[row + 1][1]);
+		}
+	}
+	uint64_t hash = RotateLeft(acc[0], 1) + RotateLeft(acc[1], 7) + RotateLeft(acc[2], 12) + RotateLeft(acc[3], 18);
+
+	// registers packed little-endian by hand so the result doesn't depend on the host
+	uint64_t v_lo = 0, v_hi = 0;
+	uint8_t i;
+	for (i = 0; i < 8; i++)
+	{
+		v_lo |= (uint64_t)state->V[i] << (8 * i);
+		v_hi |= (uint64_t)state->V[i + 8] << (8 * i);
+	}
+	hash = (hash ^ HashRound(0, v_lo)) * HASH_PRIME1 + HASH_PRIME3;
+	hash = (hash ^ HashRound(0, v_hi)) * HASH_PRIME1 + HASH_PRIME3;
+	hash = (hash ^ HashRound(0, state->I | ((uint64_t)state->PC << 16))) * HASH_PRIME1 + HASH_PRIME3;
+
+	// final avalanche
+	hash ^= hash >> 33;
+	hash *= HASH_PRIME2;
+	hash ^= hash >> 29;
+	hash *= HASH_PRIME3;
+	hash ^= hash >> 32;
+	return hash;
+}
+
+void SetChip8Quirks(Chip8State* state, uint8_t quirks)
+{
+	if ((quirks & CHIP8_QUIRK_SCHIP) && !(state->quirks & CHIP8_QUIRK_SCHIP))
+	{
+		memcpy(state->memory + BIG_FONT_ADDR, big_font, sizeof(big_font));
+		InvalidateChip8Code(state, BIG_FONT_ADDR, sizeof(big_font));
+	}
+	state->quirks = quirks;
+}
+
+int FindChip8Profile(const char* name, uint8_t* quirks)
+{
+	static const struct { const char* name; uint8_t quirks; } profiles[] =
+	{
+		{ "chip8", CHIP8_PROFILE_CHIP8 },
+		{ "vip", CHIP8_PROFILE_VIP },
+		{ "schip", CHIP8_PROFILE_SCHIP },
+	};
+	uint32_t i;
+	for (i = 0; i < sizeof(profiles) / sizeof(profiles[0]); i++)
+	{
+		if (!strcmp(name, profiles[i].name))
+		{
+			*quirks = profiles[i].quirks;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+void SeedChip8Random(Chip8State* state, uint32_t seed)
+{
+	state->rng = seed ? seed : 0x9e3779b9; // xorshift gets stuck on 0
 }
 
 void DeleteChip8(Chip8State* state)
 {
-	free(state->memory);
+	free(state->decode_cache);
 	free(state);
 }
 
-void EmulateChip8Operation(Chip8State* state)
+int LoadChip8Program(Chip8State* state, const uint8_t* program, uint32_t size)
 {
-	uint8_t* op = &(state->memory[state->PC]); // fetch current instruction
-	int nib = (*op & 0xf0) >> 4; // checking first nib of first byte instead of making an operation table
-	switch (nib)
+	if (size > CHIP8_MAX_ROM_SIZE) // anything bigger would run off the end of memory
 	{
-		
-		case 0x00: //
+		return 0;
+	}
+	memcpy(state->memory + 0x200, program, size);
+	InvalidateChip8Code(state, 0x200, size);
+	return 1;
+}
+
+void EnableChip8DecodeCache(Chip8State* state)
+{
+	if (!state->decode_cache)
+	{
+		state->decode_cache = calloc(0x1000 / 2, sizeof(Chip8Instr)); // calloc leaves every slot empty
+	}
+}
+
+void InvalidateChip8Code(Chip8State* state, uint16_t addr, uint16_t len)
+{
+	if (!state->decode_cache)
+	{
+		return;
+	}
+	uint32_t i;
+	for (i = addr & ~0x1; i < (uint32_t)addr + len; i += 2)
+	{
+		state->decode_cache[(i & 0x0fff) >> 1].len = 0;
+	}
+}
+
+// every write the interpreter makes to memory goes through here so that
+// cached instructions never go stale when a ROM modifies its own code
+static inline void WriteMemory(Chip8State* state, uint16_t addr, uint8_t value)
+{
+	addr &= 0x0fff;
+	state->memory[addr] = value;
+	if (state->decode_cache)
+	{
+		state->decode_cache[addr >> 1].len = 0;
+	}
+}
+
+static inline uint16_t FetchOpcode(Chip8State* state)
+{
+	return (state->memory[state->PC & 0x0fff] << 8) | state->memory[(state->PC + 1) & 0x0fff];
+}
+
+// ---- operations ----
+// each one is responsible for moving the program counter on
+
+static inline void Op_Invalid(Chip8State* state, const Chip8Instr* in, uint8_t quirks)
+{
+	// passes instruction to another chip that I haven't implemented
+	Operation_NotImplemented(state);
+	state->stop_flags |= CHIP8_STOP_INVALID;
+	state->PC += 2;
+}
+
+static void __attribute__((noinline)) ClearHires(Chip8State* state)
+{
+	memset(state->hires_display, 0, sizeof(state->hires_display));
+	state->stop_flags |= CHIP8_STOP_DRAW;
+}
+
+QUIRK_INLINE void Op_Cls(Chip8State* state, const Chip8Instr* in, uint8_t quirks) // 00E0
+{
+	if ((quirks & CHIP8_QUIRK_SCHIP) && __builtin_expect(state->hires, 0)) // SUPER-CHIP, kept out of the dispatch loop
+	{
+		ClearHires(state);
+		state->PC += 2;
+		return;
+	}
+
+	uint8_t row;
+	for (row = 0; row < CHIP8_DISPLAY_HEIGHT; row++)
+	{
+		state->display[row] = 0;
+	}
+	state->stop_flags |= CHIP8_STOP_DRAW;
+	state->PC += 2;
+}
+
+static inline void Op_Ret(Chip8State* state, const Chip8Instr* in, uint8_t quirks) // 00EE
+{
+	// return PC up one in the stack
+	uint16_t slot = 0xea0 + state->SP;
+	state->PC = (state->memory[slot & 0x0fff] << 8) | state->memory[(slot + 1) & 0x0fff];
+	state->SP -= 2;
+}
+
+static inline void Op_Jp(Chip8State* state, const Chip8Instr* in, uint8_t quirks) // 1nnn
+{
+	state->PC = in->nnn;
+}
+
+static inline void Op_Call(Chip8State* state, const Chip8Instr* in, uint8_t quirks) // 2nnn
+{
+	// advance program counter to next instruction
+	// advance stack pointer
+	// save current program counter to stack
+	// change program counter to target address
+	state->PC += 2;
+	state->SP += 2;
+	uint16_t slot = 0xea0 + state->SP;
+	WriteMemory(state, slot, state->PC >> 8);
+	WriteMemory(state, slot + 1, state->PC & 0xff);
+	state->PC = in->nnn;
+}
+
+static inline void Op_SeByte(Chip8State* state, const Chip8Instr* in, uint8_t quirks) // 3xkk
+{
+	state->PC += (state->V[in->x] == in->kk) ? 4 : 2;
+}
+
+static inline void Op_SneByte(Chip8State* state, const Chip8Instr* in, uint8_t quirks) // 4xkk
+{
+	state->PC += (state->V[in->x] != in->kk) ? 4 : 2;
+}
+
+static inline void Op_SeReg(Chip8State* state, const Chip8Instr* in, uint8_t quirks) // 5xy0
+{
+	state->PC += (state->V[in->x] == state->V[in->y]) ? 4 : 2;
+}
+
+static inline void Op_LdByte(Chip8State* state, const Chip8Instr* in, uint8_t quirks) // 6xkk
+{
+	state->V[in->x] = in->kk;
+	state->PC += 2;
+}
+
+static inline void Op_AddByte(Chip8State* state, const Chip8Instr* in, uint8_t quirks) // 7xkk
+{
+	state->V[in->x] += in->kk;
+	state->PC += 2;
+}
+
+static inline void Op_LdReg(Chip8State* state, const Chip8Instr* in, uint8_t quirks) // 8xy0
+{
+	state->V[in->x] = state->V[in->y];
+	state->PC += 2;
+}
+
+QUIRK_INLINE void Op_Or(Chip8State* state, const Chip8Instr* in, uint8_t quirks) // 8xy1
+{
+	state->V[in->x] |= state->V[in->y];
+	if (quirks & CHIP8_QUIRK_VF_RESET)
+	{
+		state->V[15] = 0;
+	}
+	state->PC += 2;
+}
+
+QUIRK_INLINE void Op_And(Chip8State* state, const Chip8Instr* in, uint8_t quirks) // 8xy2
+{
+	state->V[in->x] &= state->V[in->y];
+	if (quirks & CHIP8_QUIRK_VF_RESET)
+	{
+		state->V[15] = 0;
+	}
+	state->PC += 2;
+}
+
+QUIRK_INLINE void Op_Xor(Chip8State* state, const Chip8Instr* in, uint8_t quirks) // 8xy3
+{
+	state->V[in->x] ^= state->V[in->y];
+	if (quirks & CHIP8_QUIRK_VF_RESET)
+	{
+		state->V[15] = 0;
+	}
+	state->PC += 2;
+}
+
+static inline void Op_AddReg(Chip8State* state, const Chip8Instr* in, uint8_t quirks) // 8xy4
+{
+	uint16_t sum = state->V[in->x] + state->V[in->y];
+	state->V[in->x] = sum & 0xff;
+	state->V[15] = sum > 0xff; // overflow sets CARRY flag
+	state->PC += 2;
+}
+
+static inline void Op_Sub(Chip8State* state, const Chip8Instr* in, uint8_t quirks) // 8xy5
+{
+	uint8_t x = state->V[in->x];
+	uint8_t y = state->V[in->y];
+	state->V[in->x] = x - y;
+	state->V[15] = x >= y; // not borrowing sets NOT BORROW flag
+	state->PC += 2;
+}
+
+QUIRK_INLINE void Op_Shr(Chip8State* state, const Chip8Instr* in, uint8_t quirks) // 8xy6
+{
+	uint8_t x = state->V[(quirks & CHIP8_QUIRK_SHIFT_VY) ? in->y : in->x];
+	state->V[in->x] = x >> 1;
+	state->V[15] = x & 0x1; // bit shifted out
+	state->PC += 2;
+}
+
+static inline void Op_Subn(Chip8State* state, const Chip8Instr* in, uint8_t quirks) // 8xy7
+{
+	uint8_t x = state->V[in->x];
+	uint8_t y = state->V[in->y];
+	state->V[in->x] = y - x;
+	state->V[15] = y >= x; // sets NOT BORROW flag
+	state->PC += 2;
+}
+
+QUIRK_INLINE void Op_Shl(Chip8State* state, const Chip8Instr* in, uint8_t quirks) // 8xyE
+{
+	uint8_t x = state->V[(quirks & CHIP8_QUIRK_SHIFT_VY) ? in->y : in->x];
+	state->V[in->x] = x << 1;
+	state->V[15] = x >> 7; // bit shifted out
+	state->PC += 2;
+}
+
+static inline void Op_SneReg(Chip8State* state, const Chip8Instr* in, uint8_t quirks) // 9xy0
+{
+	state->PC += (state->V[in->x] != state->V[in->y]) ? 4 : 2;
+}
+
+static inline void Op_LdI(Chip8State* state, const Chip8Instr* in, uint8_t quirks) // Annn
+{
+	state->I = in->nnn;
+	state->PC += 2;
+}
+
+QUIRK_INLINE void Op_JpV0(Chip8State* state, const Chip8Instr* in, uint8_t quirks) // Bnnn
+{
+	uint8_t offset = state->V[(quirks & CHIP8_QUIRK_JUMP_VX) ? in->x : 0]; // Bxnn takes x from the top of the address
+	state->PC = (offset + in->nnn) & 0x0fff; // forcing pc to remain within memory space
+}
+
+static inline void Op_Rnd(Chip8State* state, const Chip8Instr* in, uint8_t quirks) // Cxkk
+{
+	// xorshift32 kept in the state, so instances don't share (or fight over) one generator
+	uint32_t r = state->rng;
+	r ^= r << 13;
+	r ^= r >> 17;
+	r ^= r << 5;
+	state->rng = r;
+
+	uint8_t randomval = r >> 24;
+	state->V[in->x] = in->kk & randomval;
+	state->PC += 2;
+}
+
+QUIRK_INLINE void Op_Drw(Chip8State* state, const Chip8Instr* in, uint8_t quirks) // Dxyn (draw function yoshi:NIGHTMARE)
+{
+	if ((quirks & CHIP8_QUIRK_SCHIP) && (state->hires || !in->n)) // 128x64 or a 16x16 sprite
+	{
+		if (quirks & CHIP8_QUIRK_WRAP_SPRITES)
+		{
+			DrawSchipWrapped(state, in);
+		}
+		else
+		{
+			DrawSchipClipped(state, in);
+		}
+		return;
+	}
+
+	// memory location of sprite to draw
+	uint16_t target = state->I;
+
+	// target coordinates (x,y) on display, the starting point always wraps
+	uint8_t x = state->V[in->x] % CHIP8_DISPLAY_WIDTH;
+	uint8_t y = state->V[in->y] % CHIP8_DISPLAY_HEIGHT;
+	uint8_t wrap = quirks & CHIP8_QUIRK_WRAP_SPRITES;
+
+	// each sprite byte is lined up with its display row in one shift, so a
+	// whole row is drawn (and checked for collisions) with a single XOR/AND
+	uint64_t collisions = 0;
+	uint8_t i;
+	for (i = 0; i < in->n; i++)
+	{
+		uint8_t row = y + i;
+		if (row >= CHIP8_DISPLAY_HEIGHT)
+		{
+			if (!wrap)
 			{
-				int subop = (*(op + 1) & 0xff);
-				if (subop == 0xEE) // RETURN operation
-				{
-					// return PC up one in the stack
-					state->PC = state->memory[0xea0 + state->SP];
-					state->SP -= 2;
-				}
-				else if (subop == 0xE0) // clear display
-				{
-					uint16_t i;
-					for (i = 0; i < 0x100; i++) // in other words, set 0xf00..0xfff to 0's
-					{
-						state->display[i] = 0x00;
-					}
-					state->PC += 2;
-				}
-				else // passes instruction to another chip that I haven't implemented
-				{
-					// TODO look into the chip the command is passed to 
-					Operation_NotImplemented(state);
-					state->PC +=2;
-				}
+				break; // clipped off the bottom
 			}
-			break;
+			row -= CHIP8_DISPLAY_HEIGHT;
+		}
+
+		uint64_t sprite = (uint64_t)state->memory[(target + i) & 0x0fff] << 56; // leftmost pixel in the top bit
+		uint64_t pixels = sprite >> x;
+		if (wrap)
+		{
+			pixels |= sprite << ((64 - x) & 63); // what fell off the right edge comes back on the left
+		}
+
+		collisions |= state->display[row] & pixels;
+		state->display[row] ^= pixels;
+	}
+	state->stop_flags |= CHIP8_STOP_DRAW;
+	state->V[15] = collisions != 0; // set if a lit pixel was turned off
+	state->PC += 2;
+}
+
+static inline void Op_Skp(Chip8State* state, const Chip8Instr* in, uint8_t quirks) // Ex9E
+{
+	// for the purposes of testing, we'll assume pressed = 0x1, otherwise 0x0
+	state->PC += state->K[state->V[in->x] & 0x0f] ? 4 : 2;
+}
+
+static inline void Op_Sknp(Chip8State* state, const Chip8Instr* in, uint8_t quirks) // ExA1
+{
+	state->PC += state->K[state->V[in->x] & 0x0f] ? 2 : 4;
+}
+
+static inline void Op_LdVxDt(Chip8State* state, const Chip8Instr* in, uint8_t quirks) // Fx07
+{
+	state->V[in->x] = state->DT;
+	state->PC += 2;
+}
+
+static inline void Op_LdVxK(Chip8State* state, const Chip8Instr* in, uint8_t quirks) // Fx0A
+{
+	// if not waiting yet, snapshot the keyboard and don't advance PC
+	// if waiting, check to see if a key changed since the snapshot
+	// 	if no key changed, do nothing
+	// 	if a key changed, store it and advance PC
+	uint8_t kindex;
+	if (!state->waiting_for_key_press) // lock emulator into waiting for a key press
+	{
+		state->waiting_for_key_press = 0x1;
+		for (kindex = 0; kindex < 16; kindex++)
+		{
+			state->K_prev[kindex] = state->K[kindex];
+		}
+	}
+	else	// stuck at current PC until key press occurs
+	{
+		for (kindex = 0; kindex < 16; kindex++)
+		{
+			if (state->K_prev[kindex] != state->K[kindex])
+			{
+				state->V[in->x] = kindex;
+				state->waiting_for_key_press = 0x0;
+				state->PC += 2;
+				break;
+			}
+		}
+	}
+	if (state->waiting_for_key_press)
+	{
+		state->stop_flags |= CHIP8_STOP_KEY_WAIT; // no point spinning here until the host updates K
+	}
+}
+
+static inline void Op_LdDtVx(Chip8State* state, const Chip8Instr* in, uint8_t quirks) // Fx15
+{
+	state->DT = state->V[in->x];
+	state->PC += 2;
+}
+
+static inline void Op_LdStVx(Chip8State* state, const Chip8Instr* in, uint8_t quirks) // Fx18
+{
+	state->ST = state->V[in->x];
+	state->PC += 2;
+}
+
+static inline void Op_AddI(Chip8State* state, const Chip8Instr* in, uint8_t quirks) // Fx1E
+{
+	uint16_t sum = state->I + state->V[in->x];
+	state->I = sum & 0x0fff; // reduce result to 12 bits to fit address range
+	state->V[15] = sum > 0x0fff;
+	state->PC += 2;
+}
+
+static inline void Op_LdF(Chip8State* state, const Chip8Instr* in, uint8_t quirks) // Fx29
+{
+	state->I = (state->V[in->x] & 0x0f) * 5; // font lives at 0x000
+	state->PC += 2;
+}
+
+static inline void Op_LdB(Chip8State* state, const Chip8Instr* in, uint8_t quirks) // Fx33
+{
+	uint8_t x = state->V[in->x];
+	WriteMemory(state, state->I, x / 100); // decimal hundred's
+	WriteMemory(state, state->I + 1, (x / 10) % 10); // decimal ten's
+	WriteMemory(state, state->I + 2, x % 10); // decimal one's
+	state->PC += 2;
+}
+
+QUIRK_INLINE void Op_LdMemVx(Chip8State* state, const Chip8Instr* in, uint8_t quirks) // Fx55
+{
+	uint8_t i;
+	for (i = 0; i <= in->x; i++)
+	{
+		WriteMemory(state, state->I + i, state->V[i]);
+	}
+	if (quirks & CHIP8_QUIRK_LOAD_STORE_I)
+	{
+		state->I = (state->I + in->x + 1) & 0x0fff;
+	}
+	state->PC += 2;
+}
+
+QUIRK_INLINE void Op_LdVxMem(Chip8State* state, const Chip8Instr* in, uint8_t quirks) // Fx65
+{
+	uint8_t i;
+	for (i = 0; i <= in->x; i++)
+	{
+		state->V[i] = state->memory[(state->I + i) & 0x0fff];
+	}
+	if (quirks & CHIP8_QUIRK_LOAD_STORE_I)
+	{
+		state->I = (state->I + in->x + 1) & 0x0fff;
+	}
+	state->PC += 2;
+}
+
+// ---- SUPER-CHIP ----
+// the 128x64 display is handled a row (two words) at a time like the 64x32 one:
+// sprites are shifted into place across both words and scrolls are word shifts
+
+// these act like any other opcode the interpreter doesn't know unless the ROM asked for SUPER-CHIP
+#define REQUIRE_SCHIP(state, in, quirks) \
+	do { \
+		if (!((quirks) & CHIP8_QUIRK_SCHIP)) \
+		{ \
+			Op_Invalid(state, in, quirks); \
+			return; \
+		} \
+	} while (0)
+
+// Dxyn in 128x64, and Dxy0 (16x16, two bytes a row) in either mode. kept out of line
+// (rare, and big), once for each way of handling the edges so the cores pick one
+// through their quirks and nothing in here checks them
+static inline __attribute__((always_inline)) void DrawSchip(Chip8State* state, const Chip8Instr* in, const uint8_t wrap)
+{
+	uint16_t target = state->I;
+	uint32_t width = state->hires ? CHIP8_HIRES_WIDTH : CHIP8_DISPLAY_WIDTH;
+	uint32_t height = state->hires ? CHIP8_HIRES_HEIGHT : CHIP8_DISPLAY_HEIGHT;
+	uint32_t x = state->V[in->x] & (width - 1);
+	uint32_t y = state->V[in->y] & (height - 1);
+	uint32_t rows = in->n ? in->n : 16;
+
+	uint64_t collisions = 0;
+	uint32_t i;
+	for (i = 0; i < rows; i++)
+	{
+		uint32_t row = y + i;
+		if (row >= height)
+		{
+			if (!wrap)
+			{
+				break; // clipped off the bottom
+			}
+			row -= height;
+		}
+
+		// sprite row lined up with the left edge, in the top bits of a word
+		uint64_t sprite;
+		if (in->n)
+		{
+			sprite = (uint64_t)state->memory[(target + i) & 0x0fff] << 56;
+		}
+		else
+		{
+			sprite = ((uint64_t)state->memory[(target + 2 * i) & 0x0fff] << 56) |
+				((uint64_t)state->memory[(target + 2 * i + 1) & 0x0fff] << 48);
+		}
+
+		if (!state->hires)
+		{
+			uint64_t pixels = sprite >> x;
+			if (wrap)
+			{
+				pixels |= sprite << ((64 - x) & 63);
+			}
+			collisions |= state->display[row] & pixels;
+			state->display[row] ^= pixels;
+			continue;
+		}
+
+		// across the two halves of the row: left holds columns 0..63, right 64..127
+		uint64_t left = 0, right = 0;
+		if (x < 64)
+		{
+			left = sprite >> x;
+			right = x ? sprite << (64 - x) : 0;
+		}
+		else
+		{
+			right = sprite >> (x - 64);
+		}
+		if (wrap && x > CHIP8_HIRES_WIDTH - 16)
+		{
+			left |= sprite << (CHIP8_HIRES_WIDTH - x); // what fell off the right edge comes back on the left
+		}
+
+		uint64_t* line = state->hires_display[row];
+		collisions |= (line[0] & left) | (line[1] & right);
+		line[0] ^= left;
+		line[1] ^= right;
+	}
+	state->stop_flags |= CHIP8_STOP_DRAW;
+	state->V[15] = collisions != 0; // SUPER-CHIP 1.1 counted colliding rows in 128x64, later ones settled on 0/1
+	state->PC += 2;
+}
+
+static void __attribute__((noinline)) DrawSchipClipped(Chip8State* state, const Chip8Instr* in)
+{
+	DrawSchip(state, in, 0);
+}
+
+static void __attribute__((noinline)) DrawSchipWrapped(Chip8State* state, const Chip8Instr* in)
+{
+	DrawSchip(state, in, 1);
+}
+
+// moves the whole display 'down' rows towards the bottom, then 'shift' pixels
+// sideways (positive is to the right); whatever moves in is blank
+static void __attribute__((noinline)) ScrollDisplay(Chip8State* state, uint32_t down, int shift)
+{
+	uint32_t row;
+	if (state->hires)
+	{
+		uint64_t (*rows)[2] = state->hires_display;
+		memmove(rows[down], rows[0], (CHIP8_HIRES_HEIGHT - down) * sizeof(rows[0]));
+		memset(rows[0], 0, down * sizeof(rows[0]));
+		for (row = 0; shift && row < CHIP8_HIRES_HEIGHT; row++)
+		{
+			if (shift > 0)
+			{
+				rows[row][1] = (rows[row][1] >> shift) | (rows[row][0] << (64 - shift));
+				rows[row][0] >>= shift;
+			}
+			else
+			{
+				rows[row][0] = (rows[row][0] << -shift) | (rows[row][1] >> (64 + shift));
+				rows[row][1] <<= -shift;
+			}
+		}
+	}
+	else
+	{
+		uint64_t* rows = state->display;
+		memmove(rows + down, rows, (CHIP8_DISPLAY_HEIGHT - down) * sizeof(rows[0]));
+		memset(rows, 0, down * sizeof(rows[0]));
+		for (row = 0; shift && row < CHIP8_DISPLAY_HEIGHT; row++)
+		{
+			rows[row] = shift > 0 ? rows[row] >> shift : rows[row] << -shift;
+		}
+	}
+	state->stop_flags |= CHIP8_STOP_DRAW;
+}
+
+// switching modes starts from a blank screen
+static void __attribute__((noinline)) SetResolution(Chip8State* state, uint8_t hires)
+{
+	state->hires = hires;
+	memset(state->display, 0, sizeof(state->display));
+	memset(state->hires_display, 0, sizeof(state->hires_display));
+	state->stop_flags |= CHIP8_STOP_DRAW;
+}
+
+QUIRK_INLINE void Op_ScrollDown(Chip8State* state, const Chip8Instr* in, uint8_t quirks) // 00Cn
+{
+	REQUIRE_SCHIP(state, in, quirks);
+	ScrollDisplay(state, in->n, 0); // in pixels of the current mode, like the later interpreters
+	state->PC += 2;
+}
+
+QUIRK_INLINE void Op_ScrollRight(Chip8State* state, const Chip8Instr* in, uint8_t quirks) // 00FB
+{
+	REQUIRE_SCHIP(state, in, quirks);
+	ScrollDisplay(state, 0, 4);
+	state->PC += 2;
+}
+
+QUIRK_INLINE void Op_ScrollLeft(Chip8State* state, const Chip8Instr* in, uint8_t quirks) // 00FC
+{
+	REQUIRE_SCHIP(state, in, quirks);
+	ScrollDisplay(state, 0, -4);
+	state->PC += 2;
+}
+
+QUIRK_INLINE void Op_Exit(Chip8State* state, const Chip8Instr* in, uint8_t quirks) // 00FD
+{
+	REQUIRE_SCHIP(state, in, quirks);
+	state->stop_flags |= CHIP8_STOP_EXIT; // PC stays put, the program is done
+}
+
+QUIRK_INLINE void Op_Lores(Chip8State* state, const Chip8Instr* in, uint8_t quirks) // 00FE
+{
+	REQUIRE_SCHIP(state, in, quirks);
+	SetResolution(state, 0);
+	state->PC += 2;
+}
 
-		case 0x01: // jump to location specified by given value
-			{
-				uint16_t firsthalf = *op & 0x0f;
-				firsthalf  = firsthalf << 8;
-				uint16_t target = firsthalf | (*(op + 1) & 0xff);
-				state->PC = target;
-			}
-			break;
+QUIRK_INLINE void Op_Hires(Chip8State* state, const Chip8Instr* in, uint8_t quirks) // 00FF
+{
+	REQUIRE_SCHIP(state, in, quirks);
+	SetResolution(state, 1);
+	state->PC += 2;
+}
 
-		case 0x02: // call subroutine at given addr
-			{
-				uint16_t target = (*op & 0x0f << 8) | (*(op + 1) & 0xff);
-				state->PC += 2;
-				state->SP += 2;
-				state->memory[0xea0 + state->SP] = state->PC;
-				state->PC = target;
-				
-				// advance program counter to next instruction
-				// advance stack pointer
-				// save current program counter to stack
-				// change program counter to target address
-			}
-			break;
+QUIRK_INLINE void Op_LdHf(Chip8State* state, const Chip8Instr* in, uint8_t quirks) // Fx30
+{
+	REQUIRE_SCHIP(state, in, quirks);
+	state->I = BIG_FONT_ADDR + (state->V[in->x] & 0x0f) * 10;
+	state->PC += 2;
+}
 
-		case 0x03: // skip next instruction if Vx equals given value
-			{
-				uint8_t value = state->V[*op & 0x0f];
-				if (value == *(op + 1))
-				{
-					state->PC += 2;
-				}
-				state->PC += 2;
-			}
-			break;
+QUIRK_INLINE void Op_LdRVx(Chip8State* state, const Chip8Instr* in, uint8_t quirks) // Fx75
+{
+	REQUIRE_SCHIP(state, in, quirks);
+	memcpy(state->rpl, state->V, in->x + 1); // the HP-48 only had 8 of these, later interpreters have 16
+	state->PC += 2;
+}
 
-		case 0x04: // skip next instruction if Vx does NOT equal given value
-			{
-				uint8_t value = state->V[*op & 0x0f];
-				if (value != *(op + 1))
-				{
-					state->PC += 2;
-				}
-				state->PC += 2;
-			}
-			break;
+QUIRK_INLINE void Op_LdVxR(Chip8State* state, const Chip8Instr* in, uint8_t quirks) // Fx85
+{
+	REQUIRE_SCHIP(state, in, quirks);
+	memcpy(state->V, state->rpl, in->x + 1);
+	state->PC += 2;
+}
 
-		case 0x05: // skip next instruction if Vx equals Vy
-			{
-				uint8_t valuex = state->V[*op & 0x0f];
-				uint8_t valuey = state->V[*(op + 1) & 0xf0 >> 4];
-				if (valuex == valuey)
-				{
-					state->PC += 2;
-				}
-				state->PC += 2;
-			}
-			break;
+// ---- decoding ----
 
-		case 0x06: // load given value into Vx
-			{
-				uint8_t reg = *op & 0x0f;
-				uint8_t value = *(op + 1);
-				state->V[reg] = value;
-				state->PC += 2;
-			}
-			break;
+static void DecodeInstruction(uint16_t opcode, Chip8Instr* in)
+{
+	in->nnn = opcode & 0x0fff;
+	in->x = (opcode >> 8) & 0x0f;
+	in->y = (opcode >> 4) & 0x0f;
+	in->kk = opcode & 0xff;
+	in->n = opcode & 0x0f;
 
-		case 0x07: // add given value into target register's value
-			{
-				uint8_t reg = *op & 0x0f;
-				uint8_t val = *(op + 1);
-				state->V[reg] += val;
-				state->PC += 2;
-			}
+	uint8_t kind = KIND_Invalid;
+	switch (opcode >> 12)
+	{
+		case 0x0:
+			if (opcode == 0x00e0) kind = KIND_Cls;
+			else if (opcode == 0x00ee) kind = KIND_Ret;
+			else if ((opcode & 0xfff0) == 0x00c0) kind = KIND_ScrollDown;
+			else if (opcode == 0x00fb) kind = KIND_ScrollRight;
+			else if (opcode == 0x00fc) kind = KIND_ScrollLeft;
+			else if (opcode == 0x00fd) kind = KIND_Exit;
+			else if (opcode == 0x00fe) kind = KIND_Lores;
+			else if (opcode == 0x00ff) kind = KIND_Hires;
 			break;
-
-		case 0x08: // performs an operation on two given registers depending on the last four bits
+		case 0x1: kind = KIND_Jp; break;
+		case 0x2: kind = KIND_Call; break;
+		case 0x3: kind = KIND_SeByte; break;
+		case 0x4: kind = KIND_SneByte; break;
+		case 0x5: if (in->n == 0x0) kind = KIND_SeReg; break;
+		case 0x6: kind = KIND_LdByte; break;
+		case 0x7: kind = KIND_AddByte; break;
+		case 0x8:
+			switch (in->n)
 			{
-				uint8_t regx = *op & 0x0f;
-				uint8_t regy = *(op + 1) & 0xf0 >> 4;
-				uint8_t lownib = *(op+1) & 0x0f;
-				Operation_8xy(state, regx, regy, lownib);
-				state->PC += 2; // all operations are arithmetic, so I put the PC advancement here
+				case 0x0: kind = KIND_LdReg; break;
+				case 0x1: kind = KIND_Or; break;
+				case 0x2: kind = KIND_And; break;
+				case 0x3: kind = KIND_Xor; break;
+				case 0x4: kind = KIND_AddReg; break;
+				case 0x5: kind = KIND_Sub; break;
+				case 0x6: kind = KIND_Shr; break;
+				case 0x7: kind = KIND_Subn; break;
+				case 0xe: kind = KIND_Shl; break;
 			}
 			break;
-
-		case 0x09: // skip next instruction if values in both given registers match
-			{
-				uint8_t a = state->V[*op & 0x0f];
-				uint8_t b = state->V[(*(op+1) & 0xf0) >> 4];
-				if (a == b)
-				{
-					state->PC += 2;
-				}
-				state->PC += 2;
-			}
+		case 0x9: if (in->n == 0x0) kind = KIND_SneReg; break;
+		case 0xa: kind = KIND_LdI; break;
+		case 0xb: kind = KIND_JpV0; break;
+		case 0xc: kind = KIND_Rnd; break;
+		case 0xd: kind = KIND_Drw; break;
+		case 0xe:
+			if (in->kk == 0x9e) kind = KIND_Skp;
+			else if (in->kk == 0xa1) kind = KIND_Sknp;
 			break;
-
-		case 0x0a: // set I register equal to value (address)
+		case 0xf:
+			switch (in->kk)
 			{
-				uint16_t value = *op & 0x0f;
-				value = value << 8;
-				value = value | (*(op + 1));
-				value = value & 0x0fff; // forcing I to remain within memory space
-				state->I = value;
-				state->PC += 2;
+				case 0x07: kind = KIND_LdVxDt; break;
+				case 0x0a: kind = KIND_LdVxK; break;
+				case 0x15: kind = KIND_LdDtVx; break;
+				case 0x18: kind = KIND_LdStVx; break;
+				case 0x1e: kind = KIND_AddI; break;
+				case 0x29: kind = KIND_LdF; break;
+				case 0x30: kind = KIND_LdHf; break;
+				case 0x33: kind = KIND_LdB; break;
+				case 0x55: kind = KIND_LdMemVx; break;
+				case 0x65: kind = KIND_LdVxMem; break;
+				case 0x75: kind = KIND_LdRVx; break;
+				case 0x85: kind = KIND_LdVxR; break;
 			}
 			break;
+	}
 
-		case 0x0b: // JP Vx, nnn (jump to location equal to sum of Vx and nnn)
-			{
-				uint16_t reg0val = state->V[0];
-				uint16_t target = (*op & 0x0f);
-				target = target << 8;
-				target = target | (*(op + 1) & 0xff);
-				target = target & 0x0fff; // forcing pc to remain within memory space
-				state->PC = (reg0val + target);
-			}
-			break;
+	in->kind = kind;
+	in->len = 2;
+}
 
-		case 0x0c: // generates random byte, AND it with given value into target register
-			{
-				uint8_t reg = (*op & 0x0f);
-				uint8_t givenval = (*(op + 1) & 0xff);
-				uint8_t randomval = rand() & (0xff);
-				state->V[reg] = givenval & randomval;
-				state->PC += 2;
-			}
-			break;
+static void BuildDecodeTable(void)
+{
+	uint32_t opcode;
+	for (opcode = 0; opcode < 0x10000; opcode++)
+	{
+		DecodeInstruction(opcode, &decode_table[opcode]);
+	}
+}
 
-		case 0x0d: // DRW Vx, Vy, nibble (draw function yoshi:NIGHTMARE)
-			{
-				// memory location of sprite to draw
-				uint16_t target = state->I;
+uint8_t Chip8OperationClass(uint16_t opcode)
+{
+	pthread_once(&decode_table_once, BuildDecodeTable);
+	return decode_table[opcode].kind;
+}
 
-				// registers containing (x,y) coordinates
-				uint8_t regx = *op & 0x0f;
-				uint8_t regy = (*(op + 1) & 0xf0) >> 4;
+const char* Chip8OperationClassName(uint8_t op_class)
+{
+	static const char* const names[KIND_COUNT] =
+	{
+#define OP_NAME(name) #name,
+		CHIP8_OPERATIONS(OP_NAME)
+#undef OP_NAME
+	};
+	return op_class < KIND_COUNT ? names[op_class] : "?";
+}
 
-				// target coordinates (x,y) on display
-				uint8_t x = state->V[regx];
-				uint8_t y = state->V[regy];
+// ---- dispatch ----
 
-				// height of sprite (width is always 8)
-				uint8_t height = *(op + 1) & 0x0f;
-				uint8_t turned_off_a_bit_flag = 0x0; // set to 1 if a bit is flipped off on display
+// finds the decoded instruction at PC, going through the decode cache when it's enabled
+// (forced inline: with this many goto handlers gcc stops inlining it and merges them
+// all into one shared dispatch, which costs the threaded loop about a third of its speed)
+static inline __attribute__((always_inline)) const Chip8Instr* LookupInstruction(Chip8State* state)
+{
+	if (state->decode_cache && !(state->PC & 0x1)) // odd addresses are rare, just decode those every time
+	{
+		Chip8Instr* slot = &state->decode_cache[(state->PC & 0x0fff) >> 1];
+		if (!slot->len)
+		{
+			*slot = decode_table[FetchOpcode(state)];
+		}
+		return slot;
+	}
+	return &decode_table[FetchOpcode(state)];
+}
 
-				uint8_t i; // y-coordinate
-				for (i = 0; i < height; i++)
-				{
-					uint8_t pixels_to_write = state->memory[target + i]; // grab row of pixels for sprite at {I}
-					uint8_t pixels_on_display = state->display[x + y * 8];	
-
-					uint8_t bit;
-					for (bit = 0; bit < 8; bit++)
-					{
-						// check to see if there was a 'collision' (flipping a bit on display off)
-						if (!turned_off_a_bit_flag && (((pixels_to_write >> (7 - bit)) & 0x1) && ((pixels_on_display >> (7 - bit)) & 0x1)))
-						{
-							turned_off_a_bit_flag = 0x1;
-						}
-					}
-					state->display[x + y * 8] = pixels_on_display ^ pixels_to_write; 
-				}
-				state->V[15] = turned_off_a_bit_flag;
-				state->PC += 2;
-			}
-			break;
+// the reader fell a whole ring behind, wait for it rather than lose entries
+static void __attribute__((noinline)) WaitForTraceRoom(Chip8TraceRing* ring, uint64_t head)
+{
+	while (head - (ring->tail_seen = atomic_load_explicit(&ring->tail, memory_order_acquire)) > ring->mask)
+	{
+		sched_yield();
+	}
+}
 
-		case 0x0e: // operation depends on lower byte of opcode
-			{
-				uint8_t regx = *op & 0x0f;
-				uint8_t lowbyte = *(op + 1) & 0xff;
-				Operation_Ex(state, regx, lowbyte);
-			}
-			break;
+// appends the instruction at PC to the trace ring, before it runs
+static inline void RecordTrace(Chip8TraceRing* ring, Chip8State* state, uint64_t cycle)
+{
+	uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	if (head - ring->tail_seen > ring->mask)
+	{
+		WaitForTraceRoom(ring, head);
+	}
 
-		case 0x0f: // operation depends on lower byte of opcode
-			{
-				uint8_t regx = *op & 0x0f;
-				uint8_t lowbyte = *(op + 1) & 0xff;
-				Operation_Fx(state, regx, lowbyte);
-			}
-			break;
+	Chip8TraceEntry* entry = &ring->entries[head & ring->mask];
+	entry->cycle = cycle;
+	entry->PC = state->PC;
+	entry->opcode = FetchOpcode(state);
+	entry->I = state->I;
+	entry->unused = 0;
+	memcpy(entry->V, state->V, sizeof(entry->V));
+	atomic_store_explicit(&ring->head, head + 1, memory_order_release); // publishes the entry
+}
 
-		default:
-			{
-				//printf("ERROR: could not decode \"%02x%02x\" !\n", (*op & 0xff), (*(op + 1) & 0xff));
-				Operation_NotImplemented(state);
-				state->PC += 2;
-			}
-			break;
+// works out which of the requested reasons to stop apply after an instruction,
+// 'executed' is how many instructions the current run has done so far
+static inline uint32_t CheckStop(Chip8State* state, uint32_t stop_mask, uint64_t executed)
+{
+	uint32_t reason = state->stop_flags; // draw, key wait and invalid opcode get flagged by the operations
+	if (state->cycles_per_frame && state->frame_cycles + executed >= state->cycles_per_frame)
+	{
+		reason |= CHIP8_STOP_FRAME;
+	}
+	if (state->breakpoints && state->breakpoints[state->PC & 0x0fff])
+	{
+		reason |= CHIP8_STOP_BREAKPOINT;
 	}
+	return reason & stop_mask;
 }
 
-void Operation_8xy(Chip8State* state, uint8_t regx, uint8_t regy, uint8_t lownib)
+#if defined(CHIP8_DISPATCH_SWITCH)
+
+QUIRK_INLINE void ExecuteInstruction(Chip8State* state, uint8_t quirks)
 {
-	switch (lownib)
+	Chip8Instr decoded;
+	Chip8Instr* in = &decoded;
+	uint16_t opcode = FetchOpcode(state); // fetch current instruction
+	in->nnn = opcode & 0x0fff;
+	in->x = (opcode >> 8) & 0x0f;
+	in->y = (opcode >> 4) & 0x0f;
+	in->kk = opcode & 0xff;
+	in->n = opcode & 0x0f;
+
+	int nib = opcode >> 12; // checking first nib of first byte instead of making an operation table
+	switch (nib)
 	{
-		case 0x00: // LD Vx, Vy
-			{
-				state->V[regx] = state->V[regy];
-			}
-			break;
-		case 0x01: // OR Vx, Vy
-			{
-				uint8_t comp = state->V[regx];
-				state->V[regx] = comp | state->V[regy];
-			}
-			break;
-		case 0x02: // AND Vx, Vy
-			{
-				uint8_t comp = state->V[regx];
-				state->V[regx] = comp & state->V[regy];
-			}
-			break;
-		case 0x03: // XOR Vx, Vy
-			{
-				uint8_t comp = state->V[regx];
-				state->V[regx] = comp ^ state->V[regy];
-			}
-		case 0x04: // ADD Vx, Vy
-			{
-				uint8_t x = state->V[regx];
-				uint8_t y = state->V[regy];
-				if (x + y > 0xff)
-				{
-					state->V[15] = 0x1; // overflow sets CARRY flag
-				}
-				else
-				{
-					state->V[15] = 0x0; 
-				}
-				state->V[regx] = (x + y) % 0xff;
-			}
-			break;
-		case 0x05: // SUB Vx, Vy
-			{
-				uint8_t x = state->V[regx];
-				uint8_t y = state->V[regy];
-				if (x > y)
-				{
-					state->V[15] = 0x1; // not borrowing sets NOT BORROW flag
-				}
-				else
-				{
-					state->V[15] = 0x0;
-				}
-				state->V[regx] = (x - y) % 0xff;
-			}
-			break;
-		case 0x06: // SHR Vx {, Vy}
+		case 0x00: //
 			{
-				uint8_t x = state->V[regx];
-				if (x & 0x1) // least significant bit is set to 1?
-				{
-					state->V[15] = 0x1; // sets LOST DATA flag?
-				}
-				else
+				if (in->kk == 0xEE && in->x == 0x0) // RETURN operation
 				{
-					state->V[15] = 0x0;
+					Op_Ret(state, in, quirks);
 				}
-				state->V[regx] = x >> 1;
-			}
-			break;
-		case 0x07: // SUBN Vx, Vy
-			{
-				uint8_t x = state->V[regx];
-				uint8_t y = state->V[regy];
-				if (y > x)
+				else if (in->kk == 0xE0 && in->x == 0x0) // clear display
 				{
-					state->V[15] = 0x1; //  sets NOT BORROW flag
+					Op_Cls(state, in, quirks);
 				}
-				else
+				else if (in->x == 0x0 && in->y == 0xC) Op_ScrollDown(state, in, quirks); // SUPER-CHIP from here on
+				else if (in->kk == 0xFB && in->x == 0x0) Op_ScrollRight(state, in, quirks);
+				else if (in->kk == 0xFC && in->x == 0x0) Op_ScrollLeft(state, in, quirks);
+				else if (in->kk == 0xFD && in->x == 0x0) Op_Exit(state, in, quirks);
+				else if (in->kk == 0xFE && in->x == 0x0) Op_Lores(state, in, quirks);
+				else if (in->kk == 0xFF && in->x == 0x0) Op_Hires(state, in, quirks);
+				else // passes instruction to another chip that I haven't implemented
 				{
-					state->V[15] = 0x0;
+					Op_Invalid(state, in, quirks);
 				}
-				state->V[regx] = (y - x) & 0xff;
 			}
 			break;
-		case 0x0e: // SHL Vx {, Vy}
+
+		case 0x01: Op_Jp(state, in, quirks); break; // jump to location specified by given value
+		case 0x02: Op_Call(state, in, quirks); break; // call subroutine at given addr
+		case 0x03: Op_SeByte(state, in, quirks); break; // skip next instruction if Vx equals given value
+		case 0x04: Op_SneByte(state, in, quirks); break; // skip next instruction if Vx does NOT equal given value
+
+		case 0x05: // skip next instruction if Vx equals Vy
 			{
-				uint8_t x = state->V[regx];
-				if (x & 0x80) // most significant bit is set to 1?
-				{
-					state->V[15] = 0x1; //  sets LOST DATA flag?
-				}
-				else
-				{
-					state->V[15] = 0x0;
-				}
-				state->V[regx] = (x << 1) & 0xff;
+				if (in->n == 0x0) Op_SeReg(state, in, quirks);
+				else Op_Invalid(state, in, quirks);
 			}
 			break;
 
-		default:
+		case 0x06: Op_LdByte(state, in, quirks); break; // load given value into Vx
+		case 0x07: Op_AddByte(state, in, quirks); break; // add given value into target register's value
+		case 0x08: Operation_8xy(state, in, quirks); break; // performs an operation on two given registers depending on the last four bits
+
+		case 0x09: // skip next instruction if values in both given registers don't match
 			{
-				Operation_NotImplemented(state);
+				if (in->n == 0x0) Op_SneReg(state, in, quirks);
+				else Op_Invalid(state, in, quirks);
 			}
 			break;
+
+		case 0x0a: Op_LdI(state, in, quirks); break; // set I register equal to value (address)
+		case 0x0b: Op_JpV0(state, in, quirks); break; // JP V0, nnn (jump to location equal to sum of V0 and nnn)
+		case 0x0c: Op_Rnd(state, in, quirks); break; // generates random byte, AND it with given value into target register
+		case 0x0d: Op_Drw(state, in, quirks); break; // DRW Vx, Vy, nibble
+		case 0x0e: Operation_Ex(state, in, quirks); break; // operation depends on lower byte of opcode
+		case 0x0f: Operation_Fx(state, in, quirks); break; // operation depends on lower byte of opcode
 	}
 }
 
-void Operation_Ex(Chip8State* state, uint8_t regx, uint8_t lowbyte)
+#endif
+
+// ---- profiling ----
+// only the profiled core calls these, the others don't even check state->profile
+
+static inline void CountBefore(Chip8ProfileCounters* profile, const Chip8State* state, uint8_t kind)
 {
-	uint8_t key = state->K[state->V[regx]]; // for the purposes of testing, we'll assume pressed = 0x1, otherwise 0x0
-	switch (lowbyte)
-	{
-		case 0x9e: // check for key being down, skip next instruction if it is
-			{
-				if (key)
-				{
-					state->PC += 2;
-				}	
-			}
-			break;
-		case 0xa1: // check for key being up, skip next instruction if it is
-			{
-				if (!key)
-				{
-					state->PC += 2;
-				}
-			}
-			break;
-		default:
-			{
-				Operation_NotImplemented(state);
-			}
-			break;
-	}
-	state->PC += 2;
+	profile->pc_counts[state->PC & 0x0fff]++;
+	profile->class_counts[kind]++;
 }
 
-void Operation_Fx(Chip8State* state, uint8_t regx, uint8_t lowbyte)
+// 'cycles' is state->cycles as it is once the instruction is counted in
+static inline void CountAfter(Chip8ProfileCounters* profile, const Chip8State* state, uint8_t kind, uint64_t cycles)
 {
-	switch (lowbyte)
+	profile->instructions++;
+	if (kind == KIND_Drw)
 	{
-		case 0x07: // LD Vx, DT  (loads delay timer into Vx)
-			{
-				state->V[regx] = state->DT;
-				state->PC += 2;
-			}
-			break;
-			
-		case 0x0a:
-			{
-				// add a wait flag to chip8state struct?
-				// if not set and this is called, set flag
-				//	then don't advance PC
-				// if set, check to see if key was pressed
-				// 	if no key was pressed, do nothing
-				// 	if a key was pressed, advance PC
-			
-				if (!state->waiting_for_key_press) // lock emulator into waiting for a key press
-				{
-					state->waiting_for_key_press = 0x1;
-					uint8_t kindex;
-					for (kindex = 0; kindex < 16; kindex++)
-					{
-						state->K_prev[kindex] = state->K[kindex];
-					}
-				}
-				else	// stuck at current PC until key press occurs
-				{
-					// check for key press
-					uint8_t kindex;
-					for (kindex = 0; kindex < 16; kindex++)
-					{
-						if (state->K_prev[kindex] != state->K[kindex])
-						{
-							state->V[regx] = kindex;
-							state->waiting_for_key_press = 0x0;
-							state->PC += 2;
-							break;
-						}
-					}
-				}
+		if (profile->draws)
+		{
+			uint64_t gap = cycles - profile->last_draw;
+			profile->draw_gap_total += gap;
+			profile->draw_gap_min = gap < profile->draw_gap_min ? gap : profile->draw_gap_min;
+			profile->draw_gap_max = gap > profile->draw_gap_max ? gap : profile->draw_gap_max;
+		}
+		profile->draws++;
+		profile->last_draw = cycles;
+	}
+	else if (kind == KIND_LdVxK && state->waiting_for_key_press)
+	{
+		profile->key_wait_cycles++;
+	}
+}
 
-			}
-			break;
+// ---- cores ----
+// a run loop compiled for each CHIP8_PROFILE_*, one for any other mix of quirks,
+// and one that counts everything it runs for state->profile (any quirks too)
 
-		case 0x15: // LD DT, Vx   (loads delay timer with Vx)
-			{
-				state->DT = state->V[regx];
-				state->PC += 2;
-			}
-			break;
+#define CORE_NAME Chip8
+#define CORE_QUIRKS CHIP8_PROFILE_CHIP8
+#include "Chip8Core.h"
 
-		case 0x18: // LD ST, Vx  (loads sound timer with Vx)
-			{
-				state->ST = state->V[regx];
-				state->PC += 2;
-			}
-			break;
+#define CORE_NAME Vip
+#define CORE_QUIRKS CHIP8_PROFILE_VIP
+#include "Chip8Core.h"
 
-		case 0x1e: // ADD I, Vx  (adds Vx to address register)
-			{
-				uint8_t x = state->V[regx];
-				uint8_t overflow_flag = 0x0;
-				if (state->I + x > 0x0fff)
-					overflow_flag = 0x1;
-				state->I = (state->I + x) & 0x0fff; // reduce result to 12 bits to fit address range
-				state->V[15] = overflow_flag;
-				state->PC += 2;
-			}
-			break;
+#define CORE_NAME Schip
+#define CORE_QUIRKS CHIP8_PROFILE_SCHIP
+#include "Chip8Core.h"
 
-		case 0x29: // LD F, Vx (loads character sprite into I)
-			{
+#define CORE_NAME Any
+#define CORE_QUIRKS state->quirks
+#include "Chip8Core.h"
 
-			}
-			break;
+#define CORE_NAME Profiled
+#define CORE_QUIRKS state->quirks
+#define CORE_PROFILED
+#include "Chip8Core.h"
 
-		case 0x33: // LD B, Vx  (loads decimal value of Vx into {I}..{I+2})
-			{
-				uint8_t x = state->V[regx];
-				uint8_t hundreds = (x / 100) % 10;
-				uint8_t tens = (x / 10) % 10;
-				uint8_t ones = x % 10;
-				state->memory[state->I] = hundreds; // decimal hundred's
-				state->memory[state->I + 1] = tens; // decimal ten's
-				state->memory[state->I + 2] = ones; // decimal one's
-				state->PC += 2;
-			}
-			break;
+Chip8RunResult Chip8Run(Chip8State* state, uint64_t max_cycles, uint32_t stop_mask)
+{
+	if (state->profile)
+	{
+		return RunCoreProfiled(state, max_cycles, stop_mask);
+	}
+	switch (state->quirks) // once per run, nothing inside the cores checks again
+	{
+		case CHIP8_PROFILE_CHIP8: return RunCoreChip8(state, max_cycles, stop_mask);
+		case CHIP8_PROFILE_VIP: return RunCoreVip(state, max_cycles, stop_mask);
+		case CHIP8_PROFILE_SCHIP: return RunCoreSchip(state, max_cycles, stop_mask);
+		default: return RunCoreAny(state, max_cycles, stop_mask);
+	}
+}
 
-		case 0x55: // LD [I], Vx (store registers V0-Vx in {I}..{I+x})
-			{
-				uint8_t i;
-				for (i = 0; i < regx + 1; i++)
-				{
-					state->memory[state->I+i] = state->V[i];
-				}
-				state->PC += 2;
-			}
-			break;
+void EmulateChip8Operation(Chip8State* state)
+{
+	Chip8Run(state, 1, 0);
+}
 
-		case 0x65: // LD Vx, [I] (loads registers V0-Vx with values stored at {I}..{I+x})
-			{
-				uint8_t i;
-				for (i = 0; i < regx + 1; i++)
-				{
-					state->V[i] = state->memory[state->I+i];
-				}
-				state->PC += 2;
-			}
-			break;
+void SetChip8Keys(Chip8State* state, uint16_t keys)
+{
+	uint8_t k;
+	for (k = 0; k < 16; k++)
+	{
+		state->K[k] = (keys >> k) & 0x1;
+	}
+}
 
-		default:
-			{
-				Operation_NotImplemented(state);
-				state->PC += 2;
-			}
-			break;
+uint16_t GetChip8Keys(const Chip8State* state)
+{
+	uint16_t keys = 0;
+	uint8_t k;
+	for (k = 0; k < 16; k++)
+	{
+		keys |= (state->K[k] != 0) << k;
+	}
+	return keys;
+}
+
+void TickChip8Timers(Chip8State* state)
+{
+	if (state->DT > 0)
+	{
+		state->DT--;
+	}
+	if (state->ST > 0)
+	{
+		state->ST--;
+	}
+}
+
+QUIRK_INLINE void Operation_8xy(Chip8State* state, const Chip8Instr* in, uint8_t quirks)
+{
+	switch (in->n)
+	{
+		case 0x00: Op_LdReg(state, in, quirks); break; // LD Vx, Vy
+		case 0x01: Op_Or(state, in, quirks); break; // OR Vx, Vy
+		case 0x02: Op_And(state, in, quirks); break; // AND Vx, Vy
+		case 0x03: Op_Xor(state, in, quirks); break; // XOR Vx, Vy
+		case 0x04: Op_AddReg(state, in, quirks); break; // ADD Vx, Vy
+		case 0x05: Op_Sub(state, in, quirks); break; // SUB Vx, Vy
+		case 0x06: Op_Shr(state, in, quirks); break; // SHR Vx {, Vy}
+		case 0x07: Op_Subn(state, in, quirks); break; // SUBN Vx, Vy
+		case 0x0e: Op_Shl(state, in, quirks); break; // SHL Vx {, Vy}
+		default: Op_Invalid(state, in, quirks); break;
+	}
+}
+
+static inline void Operation_Ex(Chip8State* state, const Chip8Instr* in, uint8_t quirks)
+{
+	switch (in->kk)
+	{
+		case 0x9e: Op_Skp(state, in, quirks); break; // check for key being down, skip next instruction if it is
+		case 0xa1: Op_Sknp(state, in, quirks); break; // check for key being up, skip next instruction if it is
+		default: Op_Invalid(state, in, quirks); break;
+	}
+}
+
+QUIRK_INLINE void Operation_Fx(Chip8State* state, const Chip8Instr* in, uint8_t quirks)
+{
+	switch (in->kk)
+	{
+		case 0x07: Op_LdVxDt(state, in, quirks); break; // LD Vx, DT  (loads delay timer into Vx)
+		case 0x0a: Op_LdVxK(state, in, quirks); break; // LD Vx, K  (waits for a key press)
+		case 0x15: Op_LdDtVx(state, in, quirks); break; // LD DT, Vx   (loads delay timer with Vx)
+		case 0x18: Op_LdStVx(state, in, quirks); break; // LD ST, Vx  (loads sound timer with Vx)
+		case 0x1e: Op_AddI(state, in, quirks); break; // ADD I, Vx  (adds Vx to address register)
+		case 0x29: Op_LdF(state, in, quirks); break; // LD F, Vx (loads character sprite into I)
+		case 0x30: Op_LdHf(state, in, quirks); break; // LD HF, Vx (loads big SUPER-CHIP character sprite into I)
+		case 0x33: Op_LdB(state, in, quirks); break; // LD B, Vx  (loads decimal value of Vx into {I}..{I+2})
+		case 0x55: Op_LdMemVx(state, in, quirks); break; // LD [I], Vx (store registers V0-Vx in {I}..{I+x})
+		case 0x65: Op_LdVxMem(state, in, quirks); break; // LD Vx, [I] (loads registers V0-Vx with values stored at {I}..{I+x})
+		case 0x75: Op_LdRVx(state, in, quirks); break; // LD R, Vx (SUPER-CHIP, saves V0-Vx in the user flags)
+		case 0x85: Op_LdVxR(state, in, quirks); break; // LD Vx, R (SUPER-CHIP, loads V0-Vx from the user flags)
+		default: Op_Invalid(state, in, quirks); break;
 	}
 }
 
@@ -522,6 +1302,6 @@ void Operation_NotImplemented(Chip8State* state)
 {
 	// TODO maybe make an error log or something?
 	// you really shouldn't reach here unless
-	// A: you're loading a program that uses instructions from the Super-Chip-48
+	// A: you're loading a program that uses instructions from the Super-Chip-48 without CHIP8_QUIRK_SCHIP
 	// B: you've somehow jumped the program counter into sprite space
 }
@@ -2,33 +2,183 @@
 #define CHIP8_H_
 
 #include <stdint.h>
+#include <stdatomic.h>
 
-typedef struct Chip8State
+#define CHIP8_DISPLAY_WIDTH 64
+#define CHIP8_DISPLAY_HEIGHT 32
+#define CHIP8_HIRES_WIDTH 128 // SUPER-CHIP high-res mode
+#define CHIP8_HIRES_HEIGHT 64
+#define CHIP8_MEMORY_SIZE 0x1000
+#define CHIP8_MAX_ROM_SIZE (CHIP8_MEMORY_SIZE - 0x200) // programs load at 0x200, below that is the interpreter's
+#define CHIP8_OPERATION_CLASSES 44 // distinct operations the decoder knows, class 0 is any invalid opcode
+
+// behaviours that differ between interpreters
+#define CHIP8_QUIRK_WRAP_SPRITES 0x01 // sprites wrap around the screen edges instead of being clipped
+#define CHIP8_QUIRK_SCHIP 0x02 // SUPER-CHIP 1.1 machine: 00Cn, 00FB-00FF, Dxy0, Fx30, Fx75, Fx85 and 128x64, see SetChip8Quirks
+#define CHIP8_QUIRK_SHIFT_VY 0x04 // 8xy6/8xyE shift Vy into Vx instead of shifting Vx in place
+#define CHIP8_QUIRK_LOAD_STORE_I 0x08 // Fx55/Fx65 leave I pointing past the last register
+#define CHIP8_QUIRK_JUMP_VX 0x10 // Bnnn is Bxnn, jumping to xnn + Vx instead of nnn + V0
+#define CHIP8_QUIRK_VF_RESET 0x20 // 8xy1/8xy2/8xy3 clear VF
+
+// the quirks of some well known interpreters. each of these runs on an
+// interpreter core compiled just for it, any other mix of quirks works too but
+// runs on a core that checks them as it goes
+#define CHIP8_PROFILE_CHIP8 0 // what this interpreter has always done
+#define CHIP8_PROFILE_VIP (CHIP8_QUIRK_SHIFT_VY | CHIP8_QUIRK_LOAD_STORE_I | CHIP8_QUIRK_VF_RESET) // the original COSMAC VIP one
+#define CHIP8_PROFILE_SCHIP (CHIP8_QUIRK_SCHIP | CHIP8_QUIRK_JUMP_VX) // SUPER-CHIP 1.1
+
+// reasons Chip8Run gives back control, also used as its stop mask
+#define CHIP8_STOP_FRAME 0x01 // cycles_per_frame instructions have run since the last frame
+#define CHIP8_STOP_KEY_WAIT 0x02 // blocked on Fx0A
+#define CHIP8_STOP_DRAW 0x04 // 00E0, Dxyn, a scroll or a mode switch changed the display
+#define CHIP8_STOP_BREAKPOINT 0x08 // PC landed on an address set in state->breakpoints
+#define CHIP8_STOP_INVALID 0x10 // hit an opcode we don't implement
+#define CHIP8_STOP_EXIT 0x20 // 00FD (SUPER-CHIP) halted the program, PC stays on it
+
+// one instruction as the tracer sees it, taken just before it runs
+typedef struct Chip8TraceEntry
 {
-	// memory pointers
-	uint8_t* memory;
-	uint8_t* display;
+	uint64_t cycle; // state->cycles at the time
+	uint16_t PC;
+	uint16_t opcode;
+	uint16_t I;
+	uint16_t unused;
+	uint8_t V[16];
+} Chip8TraceEntry;
 
-	// keyboard
-	uint8_t K[16];
-	uint8_t K_prev[16];
+// single-producer single-consumer ring the interpreter records into while state->trace
+// is set; whoever set it up drains it from another thread (see Chip8Tracer.h)
+typedef struct Chip8TraceRing
+{
+	Chip8TraceEntry* entries;
+	uint64_t mask; // capacity - 1, capacity is a power of two
+	_Atomic uint64_t head __attribute__((aligned(64))); // next entry the interpreter fills
+	uint64_t tail_seen; // the interpreter's last look at tail, so it doesn't touch the reader's line every time
+	_Atomic uint64_t tail __attribute__((aligned(64))); // next entry the reader takes
+} Chip8TraceRing;
+
+// what the interpreter counts while state->profile is set (see Chip8Profile.h)
+typedef struct Chip8ProfileCounters
+{
+	uint64_t pc_counts[CHIP8_MEMORY_SIZE]; // executions per address
+	uint64_t class_counts[CHIP8_OPERATION_CLASSES];
+	uint64_t instructions;
+
+	uint64_t draws;
+	uint64_t last_draw; // state->cycles just after the last Dxyn
+	uint64_t draw_gap_min;
+	uint64_t draw_gap_max;
+	uint64_t draw_gap_total;
+
+	uint64_t key_wait_cycles; // Fx0A instructions that left the ROM still waiting
+} Chip8ProfileCounters;
+
+typedef struct Chip8State
+{
+	// everything the run loop touches on every instruction shares the first cache line
+	struct Chip8Instr* decode_cache __attribute__((aligned(64))); // one decoded instruction per even address, NULL when disabled
+	uint8_t* breakpoints; // 0x1000 flags owned by the host, non-zero stops at that address; NULL for none
 
 	uint8_t V[16]; // 16 8-bit general purpose registers
 	uint16_t I; // 16-bit address register
 	uint16_t PC; // program counter
 
+	uint32_t frame_cycles; // instructions executed in the current frame, the host resets it
+	uint32_t cycles_per_frame; // for CHIP8_STOP_FRAME, 0 means frames never end
+	uint32_t stop_flags; // CHIP8_STOP_* raised by the operations during a run
+
 	uint8_t SP; // stack pointer
 	uint8_t DT; // delay timer
 	uint8_t ST; // sound timer
 
 	// emulator-dependant stuff
 	uint8_t waiting_for_key_press;
-	
+	uint8_t quirks; // CHIP8_QUIRK_* flags
+	uint8_t hires; // SUPER-CHIP 128x64 mode is on, drawing goes to hires_display instead of display
+	uint64_t cycles; // instructions executed since InitChip8
+
+	uint32_t rng; // Cxkk generator state, see SeedChip8Random
+	Chip8TraceRing* trace; // every instruction gets recorded here while it's set; NULL for none
+	Chip8ProfileCounters* profile; // every instruction gets counted here while it's set (on a core of its own); NULL for none
+
+	// keyboard
+	uint8_t K[16];
+	uint8_t K_prev[16];
+
+	uint8_t rpl[16]; // SUPER-CHIP user flags, Fx75/Fx85 keep registers here
+
+	// one 64-bit word per row, leftmost pixel in the most significant bit
+	uint64_t display[CHIP8_DISPLAY_HEIGHT] __attribute__((aligned(64)));
+
+	// the same for the 128x64 mode, two words per row with the left half first.
+	// blank in every other mode
+	uint64_t hires_display[CHIP8_HIRES_HEIGHT][2] __attribute__((aligned(64)));
+
+	// chip-8 has 4kb of memory available to it (0x000..0xfff), kept inline so
+	// there's no pointer to chase and a whole instance is one block
+	uint8_t memory[CHIP8_MEMORY_SIZE] __attribute__((aligned(64)));
 } Chip8State;
 
+typedef struct Chip8RunResult
+{
+	uint64_t cycles; // instructions executed
+	uint32_t reason; // CHIP8_STOP_* bits that ended the run, 0 if max_cycles ran out
+} Chip8RunResult;
+
 Chip8State* InitChip8(void);
 void DeleteChip8(Chip8State* state);
 
+// sets up a state in storage the caller owns (64-byte aligned), for packing lots of
+// instances together; don't DeleteChip8 these, but do free any decode cache
+void InitChip8At(Chip8State* state);
+
+// turns state into a copy of 'from' with a single memcpy, the cheap way to start
+// lots of instances off the same template (see Chip8Pool.h). state keeps its own
+// decode cache, emptied; anything else 'from' points to (breakpoints, trace, profile) is shared
+void ResetChip8(Chip8State* state, const Chip8State* from);
+
+// picks the CHIP8_QUIRK_* behaviours. turning on CHIP8_QUIRK_SCHIP also puts its
+// big hex font in the interpreter area, so use this rather than setting state->quirks
+void SetChip8Quirks(Chip8State* state, uint8_t quirks);
+
+// the CHIP8_PROFILE_* called 'name' ("chip8", "vip" or "schip"), returns 0 if there isn't one
+int FindChip8Profile(const char* name, uint8_t* quirks);
+
+// every instance has its own random number generator, seeded with 1 by default
+void SeedChip8Random(Chip8State* state, uint32_t seed);
+
+// 64-bit hash of memory, display and registers, for telling runs apart cheaply
+uint64_t HashChip8State(const Chip8State* state);
+
+// much cheaper hash of just the display, V, I and PC, meant to be taken every frame.
+// comes out the same on any host
+uint64_t HashChip8Frame(const Chip8State* state);
+
+// copies a program into memory at 0x200, returns 0 if it doesn't fit
+int LoadChip8Program(Chip8State* state, const uint8_t* program, uint32_t size);
+
+// keeps decoded instructions around between steps so they're only decoded once
+// (only used by the TABLE and GOTO dispatchers)
+void EnableChip8DecodeCache(Chip8State* state);
+
+// must be called after writing to state->memory from outside the emulator
+void InvalidateChip8Code(Chip8State* state, uint16_t addr, uint16_t len);
+
+// which of the CHIP8_OPERATION_CLASSES an opcode decodes to, and a short name for it
+uint8_t Chip8OperationClass(uint16_t opcode);
+const char* Chip8OperationClassName(uint8_t op_class);
+
 void EmulateChip8Operation(Chip8State* state);
 
+// runs up to max_cycles instructions, returning early after any instruction that
+// raises one of the CHIP8_STOP_* reasons in stop_mask
+Chip8RunResult Chip8Run(Chip8State* state, uint64_t max_cycles, uint32_t stop_mask);
+
+// the keypad as a bitmask, bit n is key n (1 = held)
+void SetChip8Keys(Chip8State* state, uint16_t keys);
+uint16_t GetChip8Keys(const Chip8State* state);
+
+// counts DT and ST down by one, the host calls this 60 times per second
+void TickChip8Timers(Chip8State* state);
+
 #endif
@@ -0,0 +1,191 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#include "Chip8.h"
+#include "Chip8Audio.h"
+
+#define WAV_HEADER_SIZE 44
+
+void InitChip8Audio(Chip8Audio* audio, uint32_t sample_rate)
+{
+	if (sample_rate > CHIP8_AUDIO_MAX_SAMPLE_RATE)
+	{
+		sample_rate = CHIP8_AUDIO_MAX_SAMPLE_RATE;
+	}
+	audio->sample_rate = sample_rate;
+	audio->phase = 0;
+	audio->step = ((uint64_t)CHIP8_AUDIO_TONE << 32) / sample_rate;
+	audio->frames = 0;
+}
+
+uint32_t RenderChip8AudioFrame(Chip8Audio* audio, const Chip8State* state, int16_t* out)
+{
+	// frame n covers samples [n * rate / 60, (n + 1) * rate / 60)
+	uint64_t first = audio->frames * audio->sample_rate / CHIP8_FRAMES_PER_SECOND;
+	uint64_t last = (audio->frames + 1) * audio->sample_rate / CHIP8_FRAMES_PER_SECOND;
+	uint32_t count = last - first;
+	audio->frames++;
+
+	if (!state->ST)
+	{
+		memset(out, 0, count * sizeof(int16_t));
+		audio->phase = 0; // every beep starts the same way
+		return count;
+	}
+
+	uint32_t i;
+	for (i = 0; i < count; i++)
+	{
+		out[i] = (audio->phase & 0x80000000) ? -CHIP8_AUDIO_VOLUME : CHIP8_AUDIO_VOLUME;
+		audio->phase += audio->step;
+	}
+	return count;
+}
+
+// ---- ring ----
+
+Chip8AudioRing* InitChip8AudioRing(uint32_t capacity)
+{
+	uint64_t size = 1;
+	while (size < capacity)
+	{
+		size <<= 1;
+	}
+
+	Chip8AudioRing* ring = aligned_alloc(64, sizeof(Chip8AudioRing));
+	if (!ring)
+	{
+		return NULL;
+	}
+	ring->samples = malloc(size * sizeof(int16_t));
+	if (!ring->samples)
+	{
+		free(ring);
+		return NULL;
+	}
+	ring->mask = size - 1;
+	atomic_init(&ring->head, 0);
+	atomic_init(&ring->tail, 0);
+	return ring;
+}
+
+void DeleteChip8AudioRing(Chip8AudioRing* ring)
+{
+	free(ring->samples);
+	free(ring);
+}
+
+uint32_t PushChip8Audio(Chip8AudioRing* ring, const int16_t* samples, uint32_t count)
+{
+	uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+	uint64_t room = ring->mask + 1 - (head - tail);
+	if (count > room)
+	{
+		count = room; // the callback fell behind (or isn't running), drop the rest
+	}
+
+	uint32_t i;
+	for (i = 0; i < count; i++)
+	{
+		ring->samples[(head + i) & ring->mask] = samples[i];
+	}
+	atomic_store_explicit(&ring->head, head + count, memory_order_release); // publishes them
+	return count;
+}
+
+uint32_t PullChip8Audio(Chip8AudioRing* ring, int16_t* samples, uint32_t count)
+{
+	uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+	if (count > head - tail)
+	{
+		count = head - tail;
+	}
+
+	uint32_t i;
+	for (i = 0; i < count; i++)
+	{
+		samples[i] = ring->samples[(tail + i) & ring->mask];
+	}
+	atomic_store_explicit(&ring->tail, tail + count, memory_order_release); // hands the space back
+	return count;
+}
+
+// ---- WAV ----
+
+static void PutU16(uint8_t* p, uint16_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+}
+
+static void PutU32(uint8_t* p, uint32_t v)
+{
+	PutU16(p, v & 0xffff);
+	PutU16(p + 2, v >> 16);
+}
+
+// the canonical 44 byte header for 16-bit mono PCM holding 'samples' samples
+static void MakeWavHeader(uint8_t* header, uint32_t sample_rate, uint64_t samples)
+{
+	uint32_t data_size = samples * 2;
+	memcpy(header, "RIFF", 4);
+	PutU32(header + 4, 36 + data_size);
+	memcpy(header + 8, "WAVEfmt ", 8);
+	PutU32(header + 16, 16); // fmt chunk size
+	PutU16(header + 20, 1); // PCM
+	PutU16(header + 22, 1); // mono
+	PutU32(header + 24, sample_rate);
+	PutU32(header + 28, sample_rate * 2); // bytes per second
+	PutU16(header + 32, 2); // bytes per sample
+	PutU16(header + 34, 16); // bits per sample
+	memcpy(header + 36, "data", 4);
+	PutU32(header + 40, data_size);
+}
+
+int OpenChip8Wav(Chip8Wav* wav, const char* path, uint32_t sample_rate)
+{
+	wav->sample_rate = sample_rate;
+	wav->samples = 0;
+	wav->file = fopen(path, "wb");
+	if (!wav->file)
+	{
+		return 0;
+	}
+
+	uint8_t header[WAV_HEADER_SIZE];
+	MakeWavHeader(header, sample_rate, 0); // sizes get fixed up on close
+	fwrite(header, 1, WAV_HEADER_SIZE, wav->file);
+	return 1;
+}
+
+void WriteChip8Wav(Chip8Wav* wav, const int16_t* samples, uint32_t count)
+{
+	uint8_t bytes[CHIP8_AUDIO_MAX_FRAME_SAMPLES * 2];
+	while (count)
+	{
+		uint32_t n = count < CHIP8_AUDIO_MAX_FRAME_SAMPLES ? count : CHIP8_AUDIO_MAX_FRAME_SAMPLES;
+		uint32_t i;
+		for (i = 0; i < n; i++)
+		{
+			PutU16(bytes + i * 2, samples[i]);
+		}
+		fwrite(bytes, 2, n, wav->file);
+		wav->samples += n;
+		samples += n;
+		count -= n;
+	}
+}
+
+int CloseChip8Wav(Chip8Wav* wav)
+{
+	uint8_t header[WAV_HEADER_SIZE];
+	MakeWavHeader(header, wav->sample_rate, wav->samples);
+	int ok = !ferror(wav->file);
+	ok = ok && fseek(wav->file, 0, SEEK_SET) == 0 && fwrite(header, 1, WAV_HEADER_SIZE, wav->file) == WAV_HEADER_SIZE;
+	return (fclose(wav->file) == 0) && ok;
+}
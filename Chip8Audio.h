@@ -0,0 +1,80 @@
+#ifndef CHIP8AUDIO_H_
+#define CHIP8AUDIO_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "Chip8.h"
+#include "Chip8Scheduler.h"
+
+// Sound: the machine beeps for as long as ST is non-zero. A Chip8Audio turns
+// every emulated frame into sample_rate / 60 samples of square wave (carrying
+// the remainder, so no rate drifts), which makes the audio follow emulated time
+// only: the same run always comes out with the same samples, however fast it
+// went. The SDL frontend hands them to its audio callback through a
+// Chip8AudioRing, headless can write them to a WAV file instead.
+
+#define CHIP8_AUDIO_SAMPLE_RATE 48000
+#define CHIP8_AUDIO_MAX_SAMPLE_RATE 192000
+#define CHIP8_AUDIO_MAX_FRAME_SAMPLES (CHIP8_AUDIO_MAX_SAMPLE_RATE / CHIP8_FRAMES_PER_SECOND + 1)
+#define CHIP8_AUDIO_TONE 440 // Hz
+#define CHIP8_AUDIO_VOLUME 4096 // peak, out of 32767
+
+typedef struct Chip8Audio
+{
+	uint32_t sample_rate;
+	uint32_t phase; // where the square wave is, a whole cycle is 2^32
+	uint32_t step; // how far it moves per sample
+	uint64_t frames; // rendered so far
+} Chip8Audio;
+
+// sample_rate is clamped to CHIP8_AUDIO_MAX_SAMPLE_RATE
+void InitChip8Audio(Chip8Audio* audio, uint32_t sample_rate);
+
+// one frame of sound for state's ST, taken before the timers tick (so call it right
+// before EndChip8Frame). out needs room for CHIP8_AUDIO_MAX_FRAME_SAMPLES, returns
+// how many samples went in
+uint32_t RenderChip8AudioFrame(Chip8Audio* audio, const Chip8State* state, int16_t* out);
+
+// ---- ring ----
+// single-producer single-consumer, mono samples. the emulator pushes and never
+// waits (what doesn't fit is dropped), the audio callback pulls and plays silence
+// for whatever isn't there yet
+
+typedef struct Chip8AudioRing
+{
+	int16_t* samples;
+	uint64_t mask; // capacity - 1, capacity is a power of two
+	_Atomic uint64_t head __attribute__((aligned(64))); // next sample the emulator writes
+	_Atomic uint64_t tail __attribute__((aligned(64))); // next sample the callback reads
+} Chip8AudioRing;
+
+// capacity is rounded up to a power of two, it's also the most latency the ring can add
+Chip8AudioRing* InitChip8AudioRing(uint32_t capacity);
+void DeleteChip8AudioRing(Chip8AudioRing* ring);
+
+// returns how many of the samples fit
+uint32_t PushChip8Audio(Chip8AudioRing* ring, const int16_t* samples, uint32_t count);
+
+// returns how many samples were there to take, up to count
+uint32_t PullChip8Audio(Chip8AudioRing* ring, int16_t* samples, uint32_t count);
+
+// ---- WAV ----
+// 16-bit mono PCM, the sizes in the header get filled in on close
+
+typedef struct Chip8Wav
+{
+	FILE* file;
+	uint32_t sample_rate;
+	uint64_t samples;
+} Chip8Wav;
+
+// returns 0 if the file can't be created
+int OpenChip8Wav(Chip8Wav* wav, const char* path, uint32_t sample_rate);
+void WriteChip8Wav(Chip8Wav* wav, const int16_t* samples, uint32_t count);
+
+// returns 0 if anything along the way failed to write
+int CloseChip8Wav(Chip8Wav* wav);
+
+#endif
@@ -0,0 +1,476 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "Chip8.h"
+#include "Chip8Jit.h"
+#include "Chip8Display.h"
+#include "Chip8Lockstep.h"
+#include "Chip8Scheduler.h"
+
+// Micro benchmarks loop over one opcode family at a time, macro benchmarks run
+// small synthetic programs frame by frame the way the emulator does. Both go
+// through the plain interpreter, the decode cache and the recompiler, then
+// quirk profile cores, lockstep instances and the display expansion kernels get timed.
+// Everything is printed as it runs, -j also writes the results out as JSON
+// so they can be kept per commit and compared
+
+#define BENCH_INSTRUCTIONS 50000000
+#define BENCH_FRAMES 200000
+#define BENCH_LOCKSTEP_INSTANCES 1024
+#define BENCH_LOCKSTEP_CYCLES 20000
+#define BENCH_MAX_RESULTS 64
+
+// ---- micro: one opcode family each ----
+
+// 8xy* arithmetic and logic, back to back
+static const uint8_t alu_8xy[] =
+{
+	0x60, 0x05, // 200: LD V0, 05
+	0x61, 0x03, // 202: LD V1, 03
+	0x80, 0x11, // 204: OR V0, V1
+	0x80, 0x12, // 206: AND V0, V1
+	0x80, 0x13, // 208: XOR V0, V1
+	0x80, 0x14, // 20a: ADD V0, V1
+	0x80, 0x15, // 20c: SUB V0, V1
+	0x80, 0x16, // 20e: SHR V0
+	0x80, 0x17, // 210: SUBN V0, V1
+	0x80, 0x1e, // 212: SHL V0
+	0x80, 0x10, // 214: LD V0, V1
+	0x12, 0x04, // 216: JP 204
+};
+
+// Dxyn, drawing a font glyph and erasing it again as it walks across the screen
+static const uint8_t draw_dxyn[] =
+{
+	0x60, 0x00, // 200: LD V0, 00
+	0x61, 0x00, // 202: LD V1, 00
+	0xa0, 0x00, // 204: LD I, 000 (the "0" glyph)
+	0xd0, 0x15, // 206: DRW V0, V1, 5
+	0xd0, 0x15, // 208: DRW V0, V1, 5
+	0x70, 0x03, // 20a: ADD V0, 03
+	0xd0, 0x15, // 20c: DRW V0, V1, 5
+	0xd0, 0x15, // 20e: DRW V0, V1, 5
+	0x12, 0x06, // 210: JP 206
+};
+
+// Fx33/Fx55/Fx65, the instructions that touch memory through I
+static const uint8_t mem_fx33_55_65[] =
+{
+	0xa3, 0x00, // 200: LD I, 300
+	0x60, 0xff, // 202: LD V0, ff
+	0xf0, 0x33, // 204: LD B, V0
+	0xf7, 0x55, // 206: LD [I], V7
+	0xf7, 0x65, // 208: LD V7, [I]
+	0x12, 0x04, // 20a: JP 204
+};
+
+// the cheapest instructions there are, so this is mostly the cost of getting to them
+static const uint8_t dispatch[] =
+{
+	0x60, 0x01, // 200: LD V0, 01
+	0x61, 0x02, // 202: LD V1, 02
+	0x62, 0x03, // 204: LD V2, 03
+	0x63, 0x04, // 206: LD V3, 04
+	0x64, 0x05, // 208: LD V4, 05
+	0x65, 0x06, // 20a: LD V5, 06
+	0x66, 0x07, // 20c: LD V6, 07
+	0x12, 0x00, // 20e: JP 200
+};
+
+// ---- macro: small programs run a frame at a time ----
+
+// tight arithmetic loop, the common case for game ROMs
+static const uint8_t alu_loop[] =
+{
+	0x60, 0x05, // 200: LD V0, 05
+	0x61, 0x03, // 202: LD V1, 03
+	0x70, 0x01, // 204: ADD V0, 01
+	0x80, 0x14, // 206: ADD V0, V1
+	0x82, 0x01, // 208: OR V2, V0
+	0x83, 0x25, // 20a: SUB V3, V2
+	0x30, 0x00, // 20c: SE V0, 00
+	0x12, 0x04, // 20e: JP 204
+	0x12, 0x00, // 210: JP 200
+};
+
+// same loop, but Fx55 rewrites its own first instruction on every pass
+static const uint8_t self_modifying_loop[] =
+{
+	0xa2, 0x0a, // 200: LD I, 20a
+	0x60, 0x70, // 202: LD V0, 70
+	0x61, 0x01, // 204: LD V1, 01
+	0xf1, 0x55, // 206: LD [I], V1 (writes "ADD V0, 01" over 20a)
+	0x82, 0x01, // 208: OR V2, V0
+	0x60, 0x00, // 20a: (overwritten)
+	0x83, 0x25, // 20c: SUB V3, V2
+	0x12, 0x00, // 20e: JP 200
+};
+
+// what a game's main loop looks like: move a sprite, redraw it, update a
+// score with a subroutine, roll a random delay and poll a key
+static const uint8_t game_loop[] =
+{
+	0x60, 0x00, // 200: LD V0, 00
+	0x61, 0x00, // 202: LD V1, 00
+	0xa2, 0x30, // 204: LD I, 230
+	0xd0, 0x15, // 206: DRW V0, V1, 5 (erase)
+	0x70, 0x01, // 208: ADD V0, 01
+	0x71, 0x01, // 20a: ADD V1, 01
+	0xd0, 0x15, // 20c: DRW V0, V1, 5
+	0x22, 0x20, // 20e: CALL 220
+	0xe2, 0x9e, // 210: SKP V2
+	0x12, 0x04, // 212: JP 204
+	0x12, 0x00, // 214: JP 200
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // 216..21f
+	0xa3, 0x00, // 220: LD I, 300
+	0xf0, 0x33, // 222: LD B, V0
+	0xf2, 0x65, // 224: LD V2, [I]
+	0xc3, 0x0f, // 226: RND V3, 0f
+	0xf3, 0x15, // 228: LD DT, V3
+	0x00, 0xee, // 22a: RET
+	0x00, 0x00, 0x00, 0x00, // 22c..22f
+	0x3c, 0x42, 0x81, 0x42, 0x3c, // 230: sprite
+};
+
+enum { MODE_PLAIN, MODE_CACHED, MODE_JIT };
+static const char* mode_names[] = { "plain", "cached", "jit" };
+
+typedef struct BenchResult
+{
+	char name[80];
+	uint64_t iterations;
+	double ns_per_op;
+	int instructions; // an op is one chip-8 instruction, otherwise it's whatever the benchmark says
+} BenchResult;
+
+static BenchResult results[BENCH_MAX_RESULTS];
+static uint32_t result_count;
+static const char* filter; // only run benchmarks with this in their name
+
+static void AddResult(const char* name, uint64_t iterations, double ns_per_op, int instructions)
+{
+	if (result_count < BENCH_MAX_RESULTS)
+	{
+		BenchResult* r = &results[result_count++];
+		snprintf(r->name, sizeof(r->name), "%s", name);
+		r->iterations = iterations;
+		r->ns_per_op = ns_per_op;
+		r->instructions = instructions;
+	}
+}
+
+static int Selected(const char* name)
+{
+	return !filter || strstr(name, filter);
+}
+
+static double Elapsed(const struct timespec* start, const struct timespec* end)
+{
+	return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+// ns per instruction. macro runs go a frame at a time through the scheduler
+// (unthrottled), micro runs go straight through in one call
+static double RunBench(const uint8_t* program, uint32_t size, int mode, int framed)
+{
+	Chip8State* chip8 = InitChip8();
+	if (mode == MODE_CACHED)
+	{
+		EnableChip8DecodeCache(chip8);
+	}
+	LoadChip8Program(chip8, program, size);
+
+	Chip8Jit* jit = (mode == MODE_JIT) ? InitChip8Jit(chip8) : NULL;
+	if (mode == MODE_JIT && !jit)
+	{
+		DeleteChip8(chip8);
+		return 0.0; // no recompiler on this platform
+	}
+
+	Chip8Scheduler sched;
+	InitChip8Scheduler(&sched, CHIP8_DEFAULT_INSTRUCTIONS_PER_FRAME, 0);
+
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	if (framed)
+	{
+		uint64_t frames = BENCH_INSTRUCTIONS / CHIP8_DEFAULT_INSTRUCTIONS_PER_FRAME;
+		uint64_t frame;
+		for (frame = 0; frame < frames; frame++)
+		{
+			if (jit)
+			{
+				RunChip8Jit(jit, CHIP8_DEFAULT_INSTRUCTIONS_PER_FRAME);
+				EndChip8Frame(&sched, chip8);
+			}
+			else
+			{
+				RunChip8Frame(&sched, chip8);
+			}
+		}
+	}
+	else if (jit)
+	{
+		RunChip8Jit(jit, BENCH_INSTRUCTIONS);
+	}
+	else
+	{
+		Chip8Run(chip8, BENCH_INSTRUCTIONS, 0);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	if (jit)
+	{
+		DeleteChip8Jit(jit);
+	}
+	DeleteChip8(chip8);
+
+	return Elapsed(&start, &end) * 1e9 / BENCH_INSTRUCTIONS;
+}
+
+static void ReportBench(const char* group, const char* name, const uint8_t* program, uint32_t size)
+{
+	char full[64];
+	snprintf(full, sizeof(full), "%s/%s", group, name);
+	if (!Selected(full))
+	{
+		return;
+	}
+
+	double ns[3];
+	int mode;
+	for (mode = MODE_PLAIN; mode <= MODE_JIT; mode++)
+	{
+		ns[mode] = RunBench(program, size, mode, strcmp(group, "macro") == 0);
+		if (ns[mode] > 0.0)
+		{
+			char result_name[80];
+			snprintf(result_name, sizeof(result_name), "%s/%s", full, mode_names[mode]);
+			AddResult(result_name, BENCH_INSTRUCTIONS, ns[mode], 1);
+		}
+	}
+
+	printf("%-26s plain: %6.2f ns/op   cached: %6.2f ns/op (%.2fx)", full, ns[MODE_PLAIN], ns[MODE_CACHED], ns[MODE_PLAIN] / ns[MODE_CACHED]);
+	if (ns[MODE_JIT] > 0.0)
+	{
+		printf("   jit: %6.2f ns/op (%.2fx)", ns[MODE_JIT], ns[MODE_PLAIN] / ns[MODE_JIT]);
+	}
+	printf("\n");
+}
+
+// ns per instruction with a set of quirks, straight through in one call
+static double RunQuirkBench(const uint8_t* program, uint32_t size, uint8_t quirks)
+{
+	Chip8State* chip8 = InitChip8();
+	SetChip8Quirks(chip8, quirks);
+	LoadChip8Program(chip8, program, size);
+
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	Chip8Run(chip8, BENCH_INSTRUCTIONS, 0);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	DeleteChip8(chip8);
+
+	return Elapsed(&start, &end) * 1e9 / BENCH_INSTRUCTIONS;
+}
+
+// the VIP's quirks on the core compiled for them, then on the core that checks
+// state->quirks as it goes (sprite wrapping makes no difference to a program
+// that doesn't draw, but it isn't a profile so it gets the generic core)
+static void ReportQuirkBench(const char* name, const uint8_t* program, uint32_t size)
+{
+	char full[64];
+	snprintf(full, sizeof(full), "quirks/%s", name);
+	if (!Selected(full))
+	{
+		return;
+	}
+
+	char result_name[80];
+	double profile = RunQuirkBench(program, size, CHIP8_PROFILE_VIP);
+	double generic = RunQuirkBench(program, size, CHIP8_PROFILE_VIP | CHIP8_QUIRK_WRAP_SPRITES);
+	snprintf(result_name, sizeof(result_name), "%s/profile", full);
+	AddResult(result_name, BENCH_INSTRUCTIONS, profile, 1);
+	snprintf(result_name, sizeof(result_name), "%s/generic", full);
+	AddResult(result_name, BENCH_INSTRUCTIONS, generic, 1);
+
+	printf("%-26s profile: %6.2f ns/op   generic: %6.2f ns/op (%.2fx)\n", full, profile, generic, generic / profile);
+}
+
+// ns per instruction per instance, with and without AVX2 (0 if AVX2 isn't there)
+static double RunLockstepBench(const uint8_t* program, uint32_t size, int simd)
+{
+	Chip8Lockstep* ls = InitChip8Lockstep(BENCH_LOCKSTEP_INSTANCES, program, size);
+	if (simd && !ls->simd)
+	{
+		DeleteChip8Lockstep(ls);
+		return 0.0;
+	}
+	ls->simd = simd;
+
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	RunChip8Lockstep(ls, BENCH_LOCKSTEP_CYCLES);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	DeleteChip8Lockstep(ls);
+
+	return Elapsed(&start, &end) * 1e9 / ((double)BENCH_LOCKSTEP_INSTANCES * BENCH_LOCKSTEP_CYCLES);
+}
+
+static void ReportLockstepBench(const char* name, const uint8_t* program, uint32_t size)
+{
+	char full[64];
+	snprintf(full, sizeof(full), "lockstep/%s", name);
+	if (!Selected(full))
+	{
+		return;
+	}
+
+	uint64_t iterations = (uint64_t)BENCH_LOCKSTEP_INSTANCES * BENCH_LOCKSTEP_CYCLES;
+	char result_name[80];
+	double scalar = RunLockstepBench(program, size, 0);
+	double simd = RunLockstepBench(program, size, 1);
+	snprintf(result_name, sizeof(result_name), "%s/each", full);
+	AddResult(result_name, iterations, scalar, 1);
+
+	printf("%-26s  each: %6.2f ns/op", full, scalar);
+	if (simd > 0.0)
+	{
+		snprintf(result_name, sizeof(result_name), "%s/avx2", full);
+		AddResult(result_name, iterations, simd, 1);
+		printf("   avx2: %6.2f ns/op (%.2fx)", simd, scalar / simd);
+	}
+	printf("\n");
+}
+
+// expands a full 64x32 frame over and over with each kernel the CPU supports
+static void ReportExpandBench(void)
+{
+	static const char* names[] = { "scalar", "sse2", "avx2" };
+	uint64_t rows[CHIP8_DISPLAY_HEIGHT];
+	uint32_t pixels[CHIP8_DISPLAY_WIDTH * CHIP8_DISPLAY_HEIGHT];
+
+	uint64_t seed = 0x9e3779b97f4a7c15ULL;
+	int i;
+	for (i = 0; i < CHIP8_DISPLAY_HEIGHT; i++)
+	{
+		seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+		rows[i] = seed;
+	}
+
+	int kind;
+	for (kind = CHIP8_EXPAND_SCALAR; kind <= CHIP8_EXPAND_AVX2; kind++)
+	{
+		char full[64];
+		snprintf(full, sizeof(full), "expand/%s", names[kind]);
+		if (!Selected(full) || !SelectChip8Expander(kind))
+		{
+			continue;
+		}
+
+		struct timespec start, end;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		uint32_t frame;
+		for (frame = 0; frame < BENCH_FRAMES; frame++)
+		{
+			rows[frame % CHIP8_DISPLAY_HEIGHT] ^= frame; // keep the compiler from hoisting the work
+			ExpandChip8Rows(rows, 0, CHIP8_DISPLAY_HEIGHT, pixels, 0xffffffff, 0xff000000);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		double per_frame = Elapsed(&start, &end) * 1e9 / BENCH_FRAMES;
+		AddResult(full, BENCH_FRAMES, per_frame, 0);
+		printf("%-26s %8.1f ns/frame (%6.0f Mpixel/s) [check %08x]\n", full, per_frame,
+			CHIP8_DISPLAY_WIDTH * CHIP8_DISPLAY_HEIGHT / per_frame * 1e3, pixels[frame % 2048]);
+	}
+}
+
+// one object per result, close enough to Google Benchmark's layout that the
+// same tooling can read it: real_time is per op, mips only for instruction counts
+static int WriteJson(const char* path)
+{
+	FILE* f = fopen(path, "w");
+	if (!f)
+	{
+		return 0;
+	}
+
+	time_t now = time(NULL);
+	char date[32];
+	strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+#if defined(CHIP8_DISPATCH_GOTO)
+	const char* dispatch_mode = "goto";
+#elif defined(CHIP8_DISPATCH_TABLE)
+	const char* dispatch_mode = "table";
+#else
+	const char* dispatch_mode = "switch";
+#endif
+
+	fprintf(f, "{\n");
+	fprintf(f, "  \"context\": {\n");
+	fprintf(f, "    \"date\": \"%s\",\n", date);
+	fprintf(f, "    \"num_cpus\": %ld,\n", sysconf(_SC_NPROCESSORS_ONLN));
+	fprintf(f, "    \"dispatch\": \"%s\"\n", dispatch_mode);
+	fprintf(f, "  },\n");
+	fprintf(f, "  \"benchmarks\": [\n");
+
+	uint32_t i;
+	for (i = 0; i < result_count; i++)
+	{
+		const BenchResult* r = &results[i];
+		fprintf(f, "    {\"name\": \"%s\", \"iterations\": %llu, \"real_time\": %.4f, \"time_unit\": \"ns\", \"ns_per_op\": %.4f",
+			r->name, (unsigned long long)r->iterations, r->ns_per_op, r->ns_per_op);
+		if (r->instructions)
+		{
+			fprintf(f, ", \"mips\": %.2f", 1e3 / r->ns_per_op);
+		}
+		fprintf(f, "}%s\n", i + 1 < result_count ? "," : "");
+	}
+
+	fprintf(f, "  ]\n");
+	fprintf(f, "}\n");
+	return fclose(f) == 0;
+}
+
+int main(int argc, char** argv)
+{
+	const char* json_path = NULL;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "j:f:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'j': json_path = optarg; break;
+			case 'f': filter = optarg; break;
+			default:
+				{
+					printf("USAGE: chip8bench [-j JSON results file] [-f only benchmarks whose name contains this]\n");
+					exit(1);
+				}
+		}
+	}
+
+	ReportBench("micro", "alu_8xy", alu_8xy, sizeof(alu_8xy));
+	ReportBench("micro", "draw_dxyn", draw_dxyn, sizeof(draw_dxyn));
+	ReportBench("micro", "mem_fx33_55_65", mem_fx33_55_65, sizeof(mem_fx33_55_65));
+	ReportBench("micro", "dispatch", dispatch, sizeof(dispatch));
+	ReportBench("macro", "alu_loop", alu_loop, sizeof(alu_loop));
+	ReportBench("macro", "self_modifying_loop", self_modifying_loop, sizeof(self_modifying_loop));
+	ReportBench("macro", "game_loop", game_loop, sizeof(game_loop));
+	ReportQuirkBench("alu_8xy", alu_8xy, sizeof(alu_8xy));
+	ReportLockstepBench("alu_loop", alu_loop, sizeof(alu_loop));
+	ReportExpandBench();
+
+	if (json_path && !WriteJson(json_path))
+	{
+		printf("ERROR: Could not write \"%s\"\n", json_path);
+		exit(1);
+	}
+	return 0;
+}
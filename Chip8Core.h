@@ -0,0 +1,148 @@
+// One interpreter core: the run loop for whichever dispatch was picked at build
+// time. Chip8.c includes this once per quirk profile, after defining
+//	CORE_NAME	what the core's names end in, e.g. RunCoreVip
+//	CORE_QUIRKS	the CHIP8_QUIRK_* flags it runs with, a constant for the profiles
+//			or state->quirks for the core that takes any mix
+//	CORE_PROFILED	(optional) count every instruction into state->profile
+// The operations only look at quirks through 'quirks', so with a constant every
+// check folds away and the loop is left with no quirk branches at all.
+// No include guard, it's meant to be included more than once.
+
+#define CORE_PASTE_(a, b) a##b
+#define CORE_PASTE(a, b) CORE_PASTE_(a, b)
+#define CORE(name) CORE_PASTE(name, CORE_NAME)
+
+#if defined(CORE_PROFILED)
+#define CORE_PROFILE_DECL Chip8ProfileCounters* const profile = state->profile;
+#define CORE_COUNT_BEFORE(kind) CountBefore(profile, state, kind)
+#define CORE_COUNT_AFTER(kind) CountAfter(profile, state, kind, state->cycles + executed)
+#else
+#define CORE_PROFILE_DECL
+#define CORE_COUNT_BEFORE(kind)
+#define CORE_COUNT_AFTER(kind)
+#endif
+
+#if defined(CHIP8_DISPATCH_GOTO)
+
+// threaded interpreter: every handler jumps straight to the next one
+// instead of returning to a single shared branch
+static Chip8RunResult CORE(RunCore)(Chip8State* state, uint64_t max_cycles, uint32_t stop_mask)
+{
+	static void* const labels[KIND_COUNT] =
+	{
+#define OP_LABEL(name) &&op_##name,
+		CHIP8_OPERATIONS(OP_LABEL)
+#undef OP_LABEL
+	};
+
+	const uint8_t quirks = CORE_QUIRKS;
+	const Chip8Instr* in;
+	Chip8TraceRing* const trace = state->trace;
+	CORE_PROFILE_DECL
+	uint64_t executed = 0;
+	uint32_t reason = 0;
+	state->stop_flags = 0;
+
+#define DISPATCH() \
+	do { \
+		if (executed == max_cycles) goto done; \
+		in = LookupInstruction(state); \
+		if (trace) RecordTrace(trace, state, state->cycles + executed); \
+		CORE_COUNT_BEFORE(in->kind); \
+		goto *labels[in->kind]; \
+	} while (0)
+
+	DISPATCH();
+
+#define OP_BODY(name) \
+	op_##name: \
+		Op_##name(state, in, quirks); \
+		executed++; \
+		CORE_COUNT_AFTER(KIND_##name); \
+		if (stop_mask && (reason = CheckStop(state, stop_mask, executed))) goto done; \
+		DISPATCH();
+	CHIP8_OPERATIONS(OP_BODY)
+#undef OP_BODY
+#undef DISPATCH
+
+done:
+	state->cycles += executed;
+	state->frame_cycles += executed;
+	Chip8RunResult result = { executed, reason };
+	return result;
+}
+
+#else
+
+#if defined(CHIP8_DISPATCH_TABLE)
+
+// the handlers with this core's quirks baked in
+#define OP_HANDLER(name) \
+	static void CORE(Op_##name##_)(Chip8State* state, const Chip8Instr* in) \
+	{ \
+		Op_##name(state, in, CORE_QUIRKS); \
+	}
+CHIP8_OPERATIONS(OP_HANDLER)
+#undef OP_HANDLER
+
+#endif
+
+static Chip8RunResult CORE(RunCore)(Chip8State* state, uint64_t max_cycles, uint32_t stop_mask)
+{
+#if defined(CHIP8_DISPATCH_TABLE)
+	static const Chip8Handler handlers[KIND_COUNT] =
+	{
+#define OP_HANDLER(name) CORE(Op_##name##_),
+		CHIP8_OPERATIONS(OP_HANDLER)
+#undef OP_HANDLER
+	};
+#else
+	const uint8_t quirks = CORE_QUIRKS;
+#endif
+	Chip8TraceRing* const trace = state->trace;
+	CORE_PROFILE_DECL
+	uint64_t executed = 0;
+	uint32_t reason = 0;
+	state->stop_flags = 0;
+
+	while (executed < max_cycles)
+	{
+		if (trace)
+		{
+			RecordTrace(trace, state, state->cycles + executed);
+		}
+#if defined(CORE_PROFILED)
+		const uint8_t kind = decode_table[FetchOpcode(state)].kind; // before it runs, it may rewrite itself
+		CORE_COUNT_BEFORE(kind);
+#endif
+#if defined(CHIP8_DISPATCH_TABLE)
+		const Chip8Instr* in = LookupInstruction(state);
+		handlers[in->kind](state, in);
+#else
+		ExecuteInstruction(state, quirks);
+#endif
+		executed++;
+		CORE_COUNT_AFTER(kind);
+		if (stop_mask && (reason = CheckStop(state, stop_mask, executed)))
+		{
+			break;
+		}
+	}
+
+	state->cycles += executed;
+	state->frame_cycles += executed;
+	Chip8RunResult result = { executed, reason };
+	return result;
+}
+
+#endif
+
+#undef CORE_PROFILE_DECL
+#undef CORE_COUNT_BEFORE
+#undef CORE_COUNT_AFTER
+#undef CORE
+#undef CORE_PASTE
+#undef CORE_PASTE_
+#undef CORE_NAME
+#undef CORE_QUIRKS
+#undef CORE_PROFILED
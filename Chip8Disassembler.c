@@ -1,77 +1,109 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
+#include <pthread.h>
 
-void DisassembleChip8p(uint8_t* codebuffer, int pc)
+#include "Chip8.h"
+#include "Chip8Disassembler.h"
+
+void DisassembleChip8(const uint8_t* codebuffer, int pc, char* out, size_t size)
 {
 	// each operation code is 2 bytes
 	// first half (nibble) of first byte determines the operation
-	uint8_t* code = &codebuffer[pc]; 
+	const uint8_t* code = &codebuffer[pc]; 
 	uint8_t nib = (code[0] >> 4);
-	printf("%04x %02x %02x ", pc, code[0], code[1]);
+	out[0] = '\0'; // anything still empty at the end isn't an instruction
 	
 	switch(nib)
 	{
 
 		case 0x00: // multiple ops
 			{
-				if (code[1] == 0xE0) // Clear display
+				if (code[0] == 0x00 && code[1] == 0xE0) // Clear display
 				{
-					printf("CLS");
+					snprintf(out, size, "CLS");
 					break;
 				}
 
-				if (code[1] == 0xEE) // return from subroutine
+				if (code[0] == 0x00 && code[1] == 0xEE) // return from subroutine
 				{
-					printf("RET");
+					snprintf(out, size, "RET");
 					break;
 				}
 
-				
+				// SUPER-CHIP
+				if (code[0] == 0x00 && (code[1] & 0xf0) == 0xC0) // scroll down n rows
+				{
+					snprintf(out, size, "SCD %01x", code[1] & 0x0f);
+				}
+				if (code[0] == 0x00 && code[1] == 0xFB) // scroll right 4 pixels
+				{
+					snprintf(out, size, "SCR");
+				}
+				if (code[0] == 0x00 && code[1] == 0xFC) // scroll left 4 pixels
+				{
+					snprintf(out, size, "SCL");
+				}
+				if (code[0] == 0x00 && code[1] == 0xFD) // stop the interpreter
+				{
+					snprintf(out, size, "EXIT");
+				}
+				if (code[0] == 0x00 && code[1] == 0xFE) // 64x32 mode
+				{
+					snprintf(out, size, "LOW");
+				}
+				if (code[0] == 0x00 && code[1] == 0xFF) // 128x64 mode
+				{
+					snprintf(out, size, "HIGH");
+				}
 
 				break;
 			}	
 		case 0x01: // jump to given address
 			{
-				printf("JP %01x%02x", (code[0] & 0x0f), code[1]);
+				snprintf(out, size, "JP %01x%02x", (code[0] & 0x0f), code[1]);
 				break;
 			}
 		
 		case 0x02: // call subroutine at given address
 			{
-				printf("CALL %01x%02x", (code[0] & 0x0f), code[1]);
+				snprintf(out, size, "CALL %01x%02x", (code[0] & 0x0f), code[1]);
 				break;
 			}
 
 		case 0x03: // compares value in given register to given value, skips next instruction if they match
 			{
-				printf("SE V%u, %02x", (code[0] & 0x0f), code[1]);
+				snprintf(out, size, "SE V%u, %02x", (code[0] & 0x0f), code[1]);
 				break;
 			}
 
 		case 0x04: // compares value in given register to given value, skips next instruction if they don't match
 			{
-				printf("SNE V%u, %02x", (code[0] & 0x0f), code[1]);
+				snprintf(out, size, "SNE V%u, %02x", (code[0] & 0x0f), code[1]);
 				break;
 			}
 
 		case 0x05: // compares values in two given registers, skips next instruction if they match
 			{
-				printf("SE V%u, V%u", (code[0] & 0x0f), (code[1] & 0xf0) >> 4);
+				if ((code[1] & 0x0f) == 0x00)
+				{
+					snprintf(out, size, "SE V%u, V%u", (code[0] & 0x0f), (code[1] & 0xf0) >> 4);
+				}
 				break;
 			}
 
 		case 0x06: // load a value into a register
 			{
 				uint8_t reg = code[0] & 0x0f; // determine target register from remaining 4 bits of first byte
-				printf("LD V%u, %02x", reg, code[1]);
+				snprintf(out, size, "LD V%u, %02x", reg, code[1]);
 				break;
 			}
 
 		case 0x07: // add given register's value with given value, store value in that register
 			{
 				uint8_t reg = code[0] & 0x0f;
-				printf("ADD V%u, %02x", reg, code[1]);
+				snprintf(out, size, "ADD V%u, %02x", reg, code[1]);
 				break;
 			}
 
@@ -83,39 +115,39 @@ void DisassembleChip8p(uint8_t* codebuffer, int pc)
 				uint8_t mathop = code[1] & 0x0f;
 				if (mathop == 0x00) // set value in one register equal to value in other register
 				{
-					printf("LD V%u, V%u", regtarget, regsrc);
+					snprintf(out, size, "LD V%u, V%u", regtarget, regsrc);
 				}
 				if (mathop == 0x01) // bitwise OR
 				{
-					printf("OR V%u, V%u", regtarget, regsrc);
+					snprintf(out, size, "OR V%u, V%u", regtarget, regsrc);
 				}
 				if (mathop == 0x02) // bitwise AND
 				{
-					printf("AND V%u, V%u", regtarget, regsrc);
+					snprintf(out, size, "AND V%u, V%u", regtarget, regsrc);
 				}
 				if (mathop == 0x03) // bitwise XOR
 				{
-					printf("XOR V%u, V%u", regtarget, regsrc);
+					snprintf(out, size, "XOR V%u, V%u", regtarget, regsrc);
 				}
 				if (mathop == 0x04) // addition
 				{
-					printf("ADD V%u, V%u", regtarget, regsrc);
+					snprintf(out, size, "ADD V%u, V%u", regtarget, regsrc);
 				}
 				if (mathop == 0x05) // subtraction
 				{
-					printf("SUB V%u, V%u", regtarget, regsrc);
+					snprintf(out, size, "SUB V%u, V%u", regtarget, regsrc);
 				}
 				if (mathop == 0x06) // bitshift right
 				{
-					printf("SHR V%u, V%u", regtarget, regsrc);
+					snprintf(out, size, "SHR V%u, V%u", regtarget, regsrc);
 				}
 				if (mathop == 0x07) // subtraction 2 (it's different somehow)
 				{
-					printf("SUBN V%u, V%u", regtarget, regsrc);
+					snprintf(out, size, "SUBN V%u, V%u", regtarget, regsrc);
 				}
 				if (mathop == 0x0E) // bitshift left
 				{
-					printf("SHL, V%u, V%u", regtarget, regsrc);	
+					snprintf(out, size, "SHL V%u, V%u", regtarget, regsrc);
 				}
 
 				break;
@@ -125,25 +157,28 @@ void DisassembleChip8p(uint8_t* codebuffer, int pc)
 			{
 				uint8_t rega = code[0] & 0x0f;
 				uint8_t regb = (code[1] & 0xf0) >> 4;
-				printf("SNE V%u, V%u", rega, regb);
+				if ((code[1] & 0x0f) == 0x00)
+				{
+					snprintf(out, size, "SNE V%u, V%u", rega, regb);
+				}
 				break;
 			}
 
 		case 0x0a: // load an value (presumably an address) into the address register 
 			{
-				printf("LD I, %01x%02x", (code[0] & 0x0f), code[1]);
+				snprintf(out, size, "LD I, %01x%02x", (code[0] & 0x0f), code[1]);
 				break;
 			}
 
 		case 0x0b: // set program counter to address given plus the vaule in register 0
 			{
-				printf("JP V0, %01x%02x", (code[0] & 0x0f), code[1]);
+				snprintf(out, size, "JP V0, %01x%02x", (code[0] & 0x0f), code[1]);
 				break;
 			}
 
 		case 0x0c: // generates a random number (0..255), AND's it with the given value, and stores result in target register
 			{
-				printf("RND V%u, %02x", (code[0] & 0x0f), code[1]);
+				snprintf(out, size, "RND V%u, %02x", (code[0] & 0x0f), code[1]);
 				break;
 			}
 
@@ -151,8 +186,8 @@ void DisassembleChip8p(uint8_t* codebuffer, int pc)
 			{
 				uint8_t regx = code[0] & 0x0f;
 				uint8_t regy = (code[1] & 0xf0) >> 4;
-				uint8_t size = code[1] & 0x0f;
-				printf("DRW V%u, V%u, %01x", regx , regy, size);
+				uint8_t rows = code[1] & 0x0f;
+				snprintf(out, size, "DRW V%u, V%u, %01x", regx , regy, rows);
 				break;
 			}
 
@@ -161,11 +196,11 @@ void DisassembleChip8p(uint8_t* codebuffer, int pc)
 				uint8_t reg = code[0] & 0x0f;
 				if (code[1] == 0x9e) // skip next if pressed
 				{
-					printf("SKP %u", reg);
+					snprintf(out, size, "SKP V%u", reg);
 				}
 				if (code[1] == 0xa1) // skip next if not pressed
 				{
-					printf("SKNP %u", reg);
+					snprintf(out, size, "SKNP V%u", reg);
 				}
 
 				break;
@@ -177,88 +212,406 @@ void DisassembleChip8p(uint8_t* codebuffer, int pc)
 
 				if (code[1] == 0x07) // load delay timer value into register
 				{
-					printf("LD V%u, DT", reg);
+					snprintf(out, size, "LD V%u, DT", reg);
 				}
 				if (code[1] == 0x0a) // wait for key press, store value of key into register
 				{
-					printf("LD V%u, K", reg);
+					snprintf(out, size, "LD V%u, K", reg);
 				}
 				if (code[1] == 0x15) // set delay timer equal to value in register
 				{
-					printf("LD DT, V%u", reg);
+					snprintf(out, size, "LD DT, V%u", reg);
 				}
 				if (code[1] == 0x18) // set sound timer equal to value in register
 				{
-					printf("LD ST, V%u", reg);
+					snprintf(out, size, "LD ST, V%u", reg);
 				}
 				if (code[1] == 0x1e) // add values in I and register, store result in I
 				{
-					printf("ADD I, V%u", reg);
+					snprintf(out, size, "ADD I, V%u", reg);
 				}
 				if (code[1] == 0x29) // LD F, Vx
 				{
-					printf("LD F, V%u", reg);
+					snprintf(out, size, "LD F, V%u", reg);
+				}
+				if (code[1] == 0x30) // LD HF, Vx (SUPER-CHIP big digit)
+				{
+					snprintf(out, size, "LD HF, V%u", reg);
 				}
 				if (code[1] == 0x33) // LD B, Vx
 				{
-					printf("LD B, V%u", reg);
+					snprintf(out, size, "LD B, V%u", reg);
 				}
 				if (code[1] == 0x55) // store contents of register 0 thru given register at addr stored in I
 				{
-					printf("LD [I], V%u", reg); 
+					snprintf(out, size, "LD [I], V%u", reg); 
 				}
 				if (code[1] == 0x65) // load contents of addr I in register 0 through given register
 				{
-					printf("LD V%u, [I]", reg);
+					snprintf(out, size, "LD V%u, [I]", reg);
+				}
+				if (code[1] == 0x75) // store register 0 thru given register in the SUPER-CHIP user flags
+				{
+					snprintf(out, size, "LD R, V%u", reg);
+				}
+				if (code[1] == 0x85) // load register 0 thru given register from the SUPER-CHIP user flags
+				{
+					snprintf(out, size, "LD V%u, R", reg);
 				}
 
 				break;
 			}
+	}
+
+	if (!out[0])
+	{
+		snprintf(out, size, "DW %02x%02x", code[0], code[1]);
+	}
+}
+
+void DisassembleChip8p(uint8_t* codebuffer, int pc)
+{
+	printf("%04x %02x %02x %s", pc, codebuffer[pc], codebuffer[pc + 1], Chip8Mnemonic((codebuffer[pc] << 8) | codebuffer[pc + 1]));
+}
+
+// ---- bulk listings ----
+
+#define MNEMONIC_WIDTH 16 // the longest one is "DRW V10, V10, 0"
+
+static char mnemonic_table[0x10000][MNEMONIC_WIDTH];
+static uint8_t mnemonic_length[0x10000];
+static pthread_once_t mnemonic_table_once = PTHREAD_ONCE_INIT; // listings can be made from any thread
+
+static void BuildMnemonicTable(void)
+{
+	uint32_t opcode;
+	for (opcode = 0; opcode < 0x10000; opcode++)
+	{
+		uint8_t code[2] = { opcode >> 8, opcode & 0xff };
+		DisassembleChip8(code, 0, mnemonic_table[opcode], MNEMONIC_WIDTH);
+		mnemonic_length[opcode] = strlen(mnemonic_table[opcode]);
+	}
+}
+
+const char* Chip8Mnemonic(uint16_t opcode)
+{
+	pthread_once(&mnemonic_table_once, BuildMnemonicTable);
+	return mnemonic_table[opcode];
+}
 
+size_t FormatChip8Listing(const uint8_t* memory, uint32_t start, uint32_t end, char* out, size_t size)
+{
+	static const char hex[] = "0123456789abcdef";
+	pthread_once(&mnemonic_table_once, BuildMnemonicTable);
 
-		default:
+	char* p = out;
+	uint32_t pc;
+	for (pc = start; pc < end; pc += 2)
+	{
+		if ((size_t)(p - out) + CHIP8_LISTING_LINE_SIZE > size)
+		{
+			return 0;
+		}
+
+		uint8_t hi = memory[pc];
+		uint8_t lo = memory[pc + 1];
+		uint16_t opcode = (hi << 8) | lo;
+
+		// "%04x %02x %02x %s\n" without going through printf
+		p[0] = hex[(pc >> 12) & 0xf];
+		p[1] = hex[(pc >> 8) & 0xf];
+		p[2] = hex[(pc >> 4) & 0xf];
+		p[3] = hex[pc & 0xf];
+		p[4] = ' ';
+		p[5] = hex[hi >> 4];
+		p[6] = hex[hi & 0xf];
+		p[7] = ' ';
+		p[8] = hex[lo >> 4];
+		p[9] = hex[lo & 0xf];
+		p[10] = ' ';
+		memcpy(p + 11, mnemonic_table[opcode], MNEMONIC_WIDTH); // fixed size copy, only the real length counts
+		p += 11 + mnemonic_length[opcode];
+		*p++ = '\n';
+	}
+	return p - out;
+}
+
+// ---- control flow analysis ----
+
+#define LEADER 0x80 // internal: a block starts here (on top of the CHIP8_BLOCK_* flags)
+
+enum { FLOW_NEXT, FLOW_JUMP, FLOW_CALL, FLOW_SKIP, FLOW_RETURN, FLOW_INDIRECT, FLOW_EXIT };
+
+// how an instruction passes control on
+static int ControlFlow(uint16_t opcode)
+{
+	switch (opcode >> 12)
+	{
+		case 0x0: return opcode == 0x00ee ? FLOW_RETURN : opcode == 0x00fd ? FLOW_EXIT : FLOW_NEXT;
+		case 0x1: return FLOW_JUMP;
+		case 0x2: return FLOW_CALL;
+		case 0x3: case 0x4: case 0x5: case 0x9: case 0xe: return FLOW_SKIP;
+		case 0xb: return FLOW_INDIRECT;
+	}
+	return FLOW_NEXT;
+}
+
+static uint16_t OpcodeAt(const uint8_t* memory, uint16_t addr)
+{
+	return (memory[addr] << 8) | memory[addr + 1];
+}
+
+// an instruction needs both of its bytes inside memory, and the interpreter has to know it
+static int IsInstruction(const uint8_t* memory, uint32_t addr)
+{
+	return addr + 1 < CHIP8_MEMORY_SIZE && Chip8OperationClass(OpcodeAt(memory, addr)) != 0;
+}
+
+static void AddCall(Chip8CodeMap* map, uint32_t* capacity, uint16_t from, uint16_t to)
+{
+	if (map->call_count == *capacity)
+	{
+		*capacity = *capacity ? *capacity * 2 : 16;
+		map->calls = realloc(map->calls, *capacity * sizeof(Chip8Call));
+	}
+	map->calls[map->call_count].from = from;
+	map->calls[map->call_count].to = to;
+	map->call_count++;
+}
+
+// follows every path from the addresses on the stack, marking instructions
+// as code and noting where blocks have to start
+static void TraceCode(Chip8CodeMap* map, const uint8_t* memory, uint8_t* leaders, uint16_t entry)
+{
+	uint16_t stack[CHIP8_MEMORY_SIZE]; // every address gets pushed at most once
+	uint8_t pushed[CHIP8_MEMORY_SIZE] = { 0 };
+	uint32_t depth = 0;
+	uint32_t call_capacity = 0;
+
+#define PUSH(addr) \
+	do { \
+		uint16_t a_ = (addr) & 0x0fff; \
+		if (!pushed[a_]) { pushed[a_] = 1; stack[depth++] = a_; } \
+	} while (0)
+
+	PUSH(entry);
+	while (depth)
+	{
+		uint32_t pc = stack[--depth];
+		// IsInstruction goes first, it's the bounds check (pc falls through to 0x1000 after 0xffe)
+		while (IsInstruction(memory, pc) && !(map->bytes[pc] & CHIP8_BYTE_CODE))
+		{
+			uint16_t opcode = OpcodeAt(memory, pc);
+			uint16_t nnn = opcode & 0x0fff;
+			map->bytes[pc] |= CHIP8_BYTE_CODE;
+			map->bytes[pc + 1] |= CHIP8_BYTE_OPERAND;
+
+			int flow = ControlFlow(opcode);
+			if (flow == FLOW_JUMP)
 			{
-				printf("gb");
+				leaders[nnn] |= LEADER | CHIP8_BLOCK_JUMP_TARGET;
+				PUSH(nnn);
 				break;
 			}
+			if (flow == FLOW_RETURN || flow == FLOW_INDIRECT || flow == FLOW_EXIT)
+			{
+				break;
+			}
+			if (flow == FLOW_CALL)
+			{
+				leaders[nnn] |= LEADER | CHIP8_BLOCK_SUBROUTINE;
+				PUSH(nnn);
+				AddCall(map, &call_capacity, pc, nnn);
+			}
+			if (flow == FLOW_SKIP)
+			{
+				if (pc + 4 < CHIP8_MEMORY_SIZE)
+				{
+					leaders[pc + 4] |= LEADER | CHIP8_BLOCK_JUMP_TARGET;
+					PUSH(pc + 4);
+				}
+			}
+			if (flow == FLOW_CALL || flow == FLOW_SKIP)
+			{
+				if (pc + 2 < CHIP8_MEMORY_SIZE)
+				{
+					leaders[pc + 2] |= LEADER;
+				}
+			}
+			pc += 2;
+		}
 	}
+#undef PUSH
 }
 
-int main(int argc, char** argv)
+Chip8CodeMap* AnalyzeChip8(const uint8_t* memory, uint16_t entry)
 {
-	if (argc != 2) // improper usage
+	Chip8CodeMap* map = calloc(1, sizeof(Chip8CodeMap));
+	uint8_t leaders[CHIP8_MEMORY_SIZE] = { 0 };
+	uint32_t addr;
+
+	entry &= 0x0fff;
+	leaders[entry] |= LEADER | CHIP8_BLOCK_ENTRY;
+	TraceCode(map, memory, leaders, entry);
+
+	// every block starts at a leader and runs until it passes control on some other
+	// way than falling through, or falls into the next leader
+	for (addr = 0; addr < CHIP8_MEMORY_SIZE; addr++)
 	{
-		printf("USAGE: chip8 [chip-8 ROM]\n");
-		exit(1);
+		map->block_of[addr] = -1;
+		if ((leaders[addr] & LEADER) && (map->bytes[addr] & CHIP8_BYTE_CODE))
+		{
+			map->block_count++;
+		}
 	}
+	map->blocks = calloc(map->block_count ? map->block_count : 1, sizeof(Chip8Block));
 
-	FILE* f = fopen(argv[1], "rb"); // open chip-8 rom file
-	if (!f)
+	uint32_t index = 0;
+	for (addr = 0; addr < CHIP8_MEMORY_SIZE; addr++)
 	{
-		printf("error: Couldn't open %s\n", argv[1]);
-		exit(1);
+		if (!(leaders[addr] & LEADER) || !(map->bytes[addr] & CHIP8_BYTE_CODE))
+		{
+			continue;
+		}
+
+		Chip8Block* block = &map->blocks[index];
+		block->start = addr;
+		block->flags = leaders[addr] & ~LEADER;
+
+		uint32_t pc = addr;
+		for (;;)
+		{
+			uint16_t opcode = OpcodeAt(memory, pc);
+			map->block_of[pc] = index;
+			int flow = ControlFlow(opcode);
+
+			if (flow == FLOW_JUMP)
+			{
+				block->next[block->next_count++] = opcode & 0x0fff;
+			}
+			else if (flow == FLOW_RETURN)
+			{
+				block->flags |= CHIP8_BLOCK_RETURN;
+			}
+			else if (flow == FLOW_INDIRECT)
+			{
+				block->flags |= CHIP8_BLOCK_INDIRECT;
+			}
+			else if (flow == FLOW_EXIT)
+			{
+				block->flags |= CHIP8_BLOCK_EXIT;
+			}
+			else if (flow == FLOW_SKIP)
+			{
+				block->next[block->next_count++] = pc + 2;
+				block->next[block->next_count++] = pc + 4;
+			}
+			else if (flow == FLOW_CALL)
+			{
+				block->next[block->next_count++] = pc + 2;
+			}
+			else if (pc + 2 < CHIP8_MEMORY_SIZE && (map->bytes[pc + 2] & CHIP8_BYTE_CODE) && !(leaders[pc + 2] & LEADER))
+			{
+				pc += 2;
+				continue;
+			}
+			else if (pc + 2 < CHIP8_MEMORY_SIZE && (map->bytes[pc + 2] & CHIP8_BYTE_CODE))
+			{
+				block->next[block->next_count++] = pc + 2; // falls into the next block
+			}
+			else
+			{
+				block->flags |= CHIP8_BLOCK_INVALID; // ran into something that isn't an instruction
+			}
+			block->end = pc + 2;
+			break;
+		}
+		index++;
 	}
+	return map;
+}
 
-	// determine file size
-	fseek(f, 0L, SEEK_END);
-	int fsize = ftell(f);
-	fseek(f, 0L, SEEK_SET); // reset cursor
-
-	// read ROM into buffer at 0x200
-	// this is because 0x200 is normally reserved for the interpreter
-	unsigned char* buffer = malloc(fsize + 0x200);
-	fread(buffer+0x200, fsize, 1, f);
-	fclose(f);
+void DeleteChip8CodeMap(Chip8CodeMap* map)
+{
+	free(map->blocks);
+	free(map->calls);
+	free(map);
+}
 
-	int pc = 0x200; // start program counter after reserved memory section
-	while (pc < (fsize+0x200))
+static void PrintLabel(const Chip8Block* block, FILE* out)
+{
+	if (block->flags & CHIP8_BLOCK_SUBROUTINE)
 	{
-		DisassembleChip8p(buffer, pc);
-		pc += 2; // every opcode is 2 bytes
-		printf("\n");
+		fprintf(out, "sub_%03x:\n", block->start);
 	}
+	else
+	{
+		fprintf(out, "loc_%03x:\n", block->start);
+	}
+}
 
-	free(buffer);
+void PrintChip8CodeMap(const Chip8CodeMap* map, const uint8_t* memory, uint16_t start, uint16_t end, FILE* out)
+{
+	static const char* flag_names[] = { "entry", "sub", "target", "ret", "indirect", "invalid", "exit" };
+	uint32_t i;
+	int bit;
 
-	return 0;
+	fprintf(out, "; %u blocks, %u calls\n", map->block_count, map->call_count);
+	fprintf(out, "; block start  end  next       flags\n");
+	for (i = 0; i < map->block_count; i++)
+	{
+		const Chip8Block* block = &map->blocks[i];
+		char next[16] = "-";
+		if (block->next_count == 1)
+		{
+			snprintf(next, sizeof(next), "%03x", block->next[0]);
+		}
+		else if (block->next_count == 2)
+		{
+			snprintf(next, sizeof(next), "%03x %03x", block->next[0], block->next[1]);
+		}
+		fprintf(out, "; %5u  %03x  %03x  %-9s ", i, block->start, block->end, next);
+		for (bit = 0; bit < 7; bit++)
+		{
+			if (block->flags & (1 << bit))
+			{
+				fprintf(out, " %s", flag_names[bit]);
+			}
+		}
+		fprintf(out, "\n");
+	}
+	for (i = 0; i < map->call_count; i++)
+	{
+		fprintf(out, "; call %03x -> sub_%03x\n", map->calls[i].from, map->calls[i].to);
+	}
+
+	uint32_t addr = start;
+	while (addr < end)
+	{
+		int32_t block = map->block_of[addr];
+		if (block >= 0)
+		{
+			if (map->blocks[block].start == addr)
+			{
+				PrintLabel(&map->blocks[block], out);
+			}
+			fprintf(out, "%04x %02x %02x   %s\n", addr, memory[addr], memory[addr + 1], Chip8Mnemonic(OpcodeAt(memory, addr)));
+			addr += 2;
+			continue;
+		}
+
+		// data, up to 8 bytes a line, stopping short of the next instruction
+		uint32_t run = 0;
+		while (run < 8 && addr + run < end && map->block_of[addr + run] < 0)
+		{
+			run++;
+		}
+		fprintf(out, "%04x         db", addr);
+		for (i = 0; i < run; i++)
+		{
+			fprintf(out, " %02x%s", memory[addr + i], i + 1 < run ? "," : "");
+		}
+		fprintf(out, "\n");
+		addr += run;
+	}
 }
@@ -0,0 +1,86 @@
+#ifndef CHIP8DISASSEMBLER_H_
+#define CHIP8DISASSEMBLER_H_
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "Chip8.h"
+
+#define CHIP8_MNEMONIC_SIZE 32 // enough for the longest mnemonic
+
+// writes the mnemonic for the opcode at codebuffer[pc] into out, e.g. "LD V1, 0a".
+// opcodes the interpreter doesn't know come out as "DW xxxx"
+void DisassembleChip8(const uint8_t* codebuffer, int pc, char* out, size_t size);
+
+// prints the address, the opcode bytes and the mnemonic (without a newline)
+void DisassembleChip8p(uint8_t* codebuffer, int pc);
+
+// ---- bulk listings ----
+// every opcode's mnemonic is formatted once up front (a 64K entry table, built
+// the first time it's needed), after that a listing is just copying bytes
+
+#define CHIP8_LISTING_LINE_SIZE 32 // room FormatChip8Listing needs per instruction
+
+// the same text DisassembleChip8 writes, from the table
+const char* Chip8Mnemonic(uint16_t opcode);
+
+// writes memory[start..end) two bytes at a time, one DisassembleChip8p line each,
+// into out. returns how many bytes it wrote, or 0 if size is too small
+// (CHIP8_LISTING_LINE_SIZE per instruction is always enough)
+size_t FormatChip8Listing(const uint8_t* memory, uint32_t start, uint32_t end, char* out, size_t size);
+
+// ---- control flow analysis ----
+// Recursive descent from an entry point: follows jumps (1nnn), calls (2nnn,
+// assumed to come back), skips (both ways) and stops at returns (00EE), computed
+// jumps (Bnnn), exits (00FD) and opcodes the interpreter doesn't know. Whatever
+// it reaches is code, everything else is data. The code gets split into basic
+// blocks, which is what a listing, a pre-decoder or the recompiler want to walk.
+
+// what a byte of memory turned out to be (both bits when instructions overlap)
+#define CHIP8_BYTE_CODE 0x01 // first byte of a reachable instruction
+#define CHIP8_BYTE_OPERAND 0x02 // second byte of one
+
+#define CHIP8_BLOCK_ENTRY 0x01 // where the analysis started
+#define CHIP8_BLOCK_SUBROUTINE 0x02 // something calls it
+#define CHIP8_BLOCK_JUMP_TARGET 0x04 // something jumps or skips to it
+#define CHIP8_BLOCK_RETURN 0x08 // ends with 00EE
+#define CHIP8_BLOCK_INDIRECT 0x10 // ends with Bnnn, next isn't known until it runs
+#define CHIP8_BLOCK_INVALID 0x20 // runs into an opcode the interpreter doesn't know
+#define CHIP8_BLOCK_EXIT 0x40 // ends with 00FD (SUPER-CHIP), the program stops there
+
+typedef struct Chip8Block
+{
+	uint16_t start;
+	uint16_t end; // one past its last instruction
+	uint16_t next[2]; // where control goes when it ends (a call's return address, not the callee)
+	uint8_t next_count;
+	uint8_t flags; // CHIP8_BLOCK_*
+} Chip8Block;
+
+// one 2nnn, the edges of the call graph
+typedef struct Chip8Call
+{
+	uint16_t from; // address of the call
+	uint16_t to;
+} Chip8Call;
+
+typedef struct Chip8CodeMap
+{
+	uint8_t bytes[CHIP8_MEMORY_SIZE]; // CHIP8_BYTE_* for every address, 0 for data
+	int32_t block_of[CHIP8_MEMORY_SIZE]; // block an instruction starting here belongs to, -1 if none does
+	Chip8Block* blocks; // in address order
+	uint32_t block_count;
+	Chip8Call* calls; // in the order they were found
+	uint32_t call_count;
+} Chip8CodeMap;
+
+// analyzes a whole memory image (CHIP8_MEMORY_SIZE bytes) starting from 'entry'
+Chip8CodeMap* AnalyzeChip8(const uint8_t* memory, uint16_t entry);
+void DeleteChip8CodeMap(Chip8CodeMap* map);
+
+// prints the block map, then memory[start..end) as a listing with a label on
+// every block and the bytes nothing reaches as data
+void PrintChip8CodeMap(const Chip8CodeMap* map, const uint8_t* memory, uint16_t start, uint16_t end, FILE* out);
+
+#endif
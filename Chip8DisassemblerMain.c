@@ -0,0 +1,225 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "Chip8.h"
+#include "Chip8Disassembler.h"
+#include "Chip8Rom.h"
+
+#define USAGE "USAGE: disassembler [-r] [chip-8 ROM]\n" \
+	"       disassembler -b [-r] [-t threads] [-o output directory] [chip-8 ROM]...\n"
+
+// a whole ROM archive at once: files are handed out to the threads one at a time
+typedef struct Batch
+{
+	char** paths;
+	uint32_t count;
+	const char* outdir; // NULL puts each listing next to its ROM
+	int recursive;
+	atomic_uint next; // next file nobody has taken yet
+	atomic_uint failed;
+} Batch;
+
+uint8_t* LoadImage(const char* path, long* size);
+char* ListImage(const uint8_t* image, long size, int recursive, size_t* length);
+int DisassembleFile(const Batch* batch, const char* path);
+void* BatchWorker(void* arg);
+
+// Lists a ROM two bytes at a time from 0x200, or with -r follows the control
+// flow from 0x200 instead, so sprites and other data don't get listed as code.
+// With -b every ROM gets its own listing file (ROM.asm) instead of going to stdout
+int main(int argc, char** argv)
+{
+	int recursive = 0;
+	int batch_mode = 0;
+	long threads = 0;
+	const char* outdir = NULL;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "rbt:o:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'r': recursive = 1; break;
+			case 'b': batch_mode = 1; break;
+			case 't': threads = strtol(optarg, NULL, 0); break;
+			case 'o': outdir = optarg; break;
+			default:
+				{
+					printf(USAGE);
+					exit(1);
+				}
+		}
+	}
+
+	if (batch_mode ? optind >= argc : optind != argc - 1) // improper usage
+	{
+		printf(USAGE);
+		exit(1);
+	}
+
+	if (batch_mode)
+	{
+		Batch batch;
+		batch.paths = argv + optind;
+		batch.count = argc - optind;
+		batch.outdir = outdir;
+		batch.recursive = recursive;
+		atomic_init(&batch.next, 0);
+		atomic_init(&batch.failed, 0);
+
+		if (threads <= 0)
+		{
+			threads = sysconf(_SC_NPROCESSORS_ONLN);
+		}
+		if (threads > batch.count)
+		{
+			threads = batch.count;
+		}
+		if (threads < 1)
+		{
+			threads = 1;
+		}
+
+		// the calling thread works too
+		pthread_t* workers = calloc(threads, sizeof(pthread_t));
+		long started;
+		for (started = 1; started < threads; started++)
+		{
+			if (pthread_create(&workers[started], NULL, BatchWorker, &batch) != 0)
+			{
+				break; // the ones that did start get through the rest
+			}
+		}
+		BatchWorker(&batch);
+		long i;
+		for (i = 1; i < started; i++)
+		{
+			pthread_join(workers[i], NULL);
+		}
+		free(workers);
+
+		uint32_t failed = atomic_load(&batch.failed);
+		printf("%u of %u ROMs disassembled\n", batch.count - failed, batch.count);
+		return failed ? 1 : 0;
+	}
+
+	long fsize;
+	uint8_t* buffer = LoadImage(argv[optind], &fsize);
+	if (!buffer)
+	{
+		printf("error: Couldn't read %s\n", argv[optind]);
+		exit(1);
+	}
+
+	size_t length;
+	char* listing = ListImage(buffer, fsize, recursive, &length);
+	fwrite(listing, 1, length, stdout);
+	free(listing);
+	free(buffer);
+
+	return 0;
+}
+
+// maps a ROM and copies it into a whole memory image at 0x200, NULL if it can't be read or doesn't fit
+// (0x200 is normally reserved for the interpreter)
+uint8_t* LoadImage(const char* path, long* size)
+{
+	Chip8Rom rom;
+	if (!MapChip8Rom(path, &rom))
+	{
+		return NULL;
+	}
+
+	uint8_t* image = calloc(1, CHIP8_MEMORY_SIZE + 1); // +1 so an odd sized ROM's last byte has a partner
+	memcpy(image + 0x200, rom.data, rom.size);
+	*size = rom.size;
+	UnmapChip8Rom(&rom);
+	return image;
+}
+
+// the whole listing in one malloc'd buffer
+char* ListImage(const uint8_t* image, long size, int recursive, size_t* length)
+{
+	if (recursive)
+	{
+		char* text = NULL;
+		FILE* out = open_memstream(&text, length);
+		Chip8CodeMap* map = AnalyzeChip8(image, 0x200);
+		PrintChip8CodeMap(map, image, 0x200, 0x200 + size, out);
+		DeleteChip8CodeMap(map);
+		fclose(out);
+		return text;
+	}
+
+	size_t capacity = ((size + 1) / 2) * CHIP8_LISTING_LINE_SIZE + 1;
+	char* text = malloc(capacity);
+	*length = FormatChip8Listing(image, 0x200, 0x200 + size, text, capacity);
+	return text;
+}
+
+// ROM.asm, in outdir if there is one; the listing goes out with a single write
+int DisassembleFile(const Batch* batch, const char* path)
+{
+	long fsize;
+	uint8_t* image = LoadImage(path, &fsize);
+	if (!image)
+	{
+		printf("error: Couldn't read %s\n", path);
+		return 0;
+	}
+
+	size_t length;
+	char* listing = ListImage(image, fsize, batch->recursive, &length);
+	free(image);
+
+	char out_path[4096];
+	if (batch->outdir)
+	{
+		const char* name = strrchr(path, '/');
+		snprintf(out_path, sizeof(out_path), "%s/%s.asm", batch->outdir, name ? name + 1 : path);
+	}
+	else
+	{
+		snprintf(out_path, sizeof(out_path), "%s.asm", path);
+	}
+
+	int fd = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	int ok = fd >= 0;
+	size_t done = 0;
+	while (ok && done < length)
+	{
+		ssize_t n = write(fd, listing + done, length - done); // only loops if the write comes up short
+		ok = n > 0;
+		done += ok ? n : 0;
+	}
+	if (fd >= 0 && close(fd) != 0)
+	{
+		ok = 0;
+	}
+	if (!ok)
+	{
+		printf("error: Couldn't write %s\n", out_path);
+	}
+	free(listing);
+	return ok;
+}
+
+void* BatchWorker(void* arg)
+{
+	Batch* batch = arg;
+	uint32_t i;
+	while ((i = atomic_fetch_add(&batch->next, 1)) < batch->count)
+	{
+		if (!DisassembleFile(batch, batch->paths[i]))
+		{
+			atomic_fetch_add(&batch->failed, 1);
+		}
+	}
+	return NULL;
+}
@@ -0,0 +1,113 @@
+#include <stdint.h>
+
+#include "Chip8Display.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CHIP8_HAVE_X86_SIMD
+#endif
+
+typedef void (*ExpandRowFunc)(uint64_t row, uint32_t* pixels, uint32_t on, uint32_t off);
+
+static void ExpandRowScalar(uint64_t row, uint32_t* pixels, uint32_t on, uint32_t off)
+{
+	uint32_t diff = on ^ off;
+	int x;
+	for (x = 0; x < 64; x++)
+	{
+		uint32_t lit = (row >> (63 - x)) & 0x1;
+		pixels[x] = off ^ (diff & -lit); // no branch per pixel
+	}
+}
+
+#ifdef CHIP8_HAVE_X86_SIMD
+
+// 4 pixels per step: broadcast a nibble, test one bit per lane, blend the colors
+static void ExpandRowSSE2(uint64_t row, uint32_t* pixels, uint32_t on, uint32_t off)
+{
+	const __m128i bits = _mm_set_epi32(1, 2, 4, 8); // leftmost pixel is the top bit of the nibble
+	__m128i offv = _mm_set1_epi32(off);
+	__m128i diff = _mm_set1_epi32(on ^ off);
+	int nib;
+	for (nib = 0; nib < 16; nib++)
+	{
+		__m128i v = _mm_set1_epi32((row >> (60 - 4 * nib)) & 0xf);
+		__m128i lit = _mm_cmpeq_epi32(_mm_and_si128(v, bits), bits);
+		_mm_storeu_si128((__m128i*)(pixels + 4 * nib), _mm_xor_si128(offv, _mm_and_si128(lit, diff)));
+	}
+}
+
+// 8 pixels per step, same idea with a byte at a time
+__attribute__((target("avx2")))
+static void ExpandRowAVX2(uint64_t row, uint32_t* pixels, uint32_t on, uint32_t off)
+{
+	const __m256i bits = _mm256_setr_epi32(128, 64, 32, 16, 8, 4, 2, 1);
+	__m256i offv = _mm256_set1_epi32(off);
+	__m256i diff = _mm256_set1_epi32(on ^ off);
+	int byte;
+	for (byte = 0; byte < 8; byte++)
+	{
+		__m256i v = _mm256_set1_epi32((row >> (56 - 8 * byte)) & 0xff);
+		__m256i lit = _mm256_cmpeq_epi32(_mm256_and_si256(v, bits), bits);
+		_mm256_storeu_si256((__m256i*)(pixels + 8 * byte), _mm256_xor_si256(offv, _mm256_and_si256(lit, diff)));
+	}
+}
+
+#endif
+
+static ExpandRowFunc expand_row = NULL;
+
+int SelectChip8Expander(int kind)
+{
+	switch (kind)
+	{
+		case CHIP8_EXPAND_SCALAR:
+			expand_row = ExpandRowScalar;
+			return 1;
+#ifdef CHIP8_HAVE_X86_SIMD
+		case CHIP8_EXPAND_SSE2:
+			if (!__builtin_cpu_supports("sse2")) return 0;
+			expand_row = ExpandRowSSE2;
+			return 1;
+		case CHIP8_EXPAND_AVX2:
+			if (!__builtin_cpu_supports("avx2")) return 0;
+			expand_row = ExpandRowAVX2;
+			return 1;
+#endif
+	}
+	return 0;
+}
+
+void ExpandChip8Rows(const uint64_t* rows, uint32_t first, uint32_t count, uint32_t* pixels, uint32_t on, uint32_t off)
+{
+	if (!expand_row)
+	{
+		if (!SelectChip8Expander(CHIP8_EXPAND_AVX2) && !SelectChip8Expander(CHIP8_EXPAND_SSE2))
+		{
+			SelectChip8Expander(CHIP8_EXPAND_SCALAR);
+		}
+	}
+
+	uint32_t i;
+	for (i = 0; i < count; i++)
+	{
+		expand_row(rows[first + i], pixels + i * 64, on, off);
+	}
+}
+
+int NextChip8DirtyRun(uint64_t* dirty, uint32_t* first, uint32_t* count)
+{
+	if (!*dirty)
+	{
+		return 0;
+	}
+
+	uint32_t start = __builtin_ctzll(*dirty);
+	uint64_t run = *dirty >> start;
+	uint32_t length = (~run) ? __builtin_ctzll(~run) : 64 - start; // count the ones in a row
+
+	*dirty &= ~((length == 64 ? ~0ULL : ((1ULL << length) - 1)) << start);
+	*first = start;
+	*count = length;
+	return 1;
+}
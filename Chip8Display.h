@@ -0,0 +1,26 @@
+#ifndef CHIP8DISPLAY_H_
+#define CHIP8DISPLAY_H_
+
+#include <stdint.h>
+
+// Turns the packed 1-bit display into 32-bit pixels for the host to show.
+
+enum
+{
+	CHIP8_EXPAND_SCALAR = 0,
+	CHIP8_EXPAND_SSE2,
+	CHIP8_EXPAND_AVX2,
+};
+
+// picks the kernel used by ExpandChip8Rows, returns 0 if the CPU can't run it
+// (by default the fastest supported one is picked on first use)
+int SelectChip8Expander(int kind);
+
+// expands rows [first, first + count) into 64 pixels each, pixels points at row 'first'
+void ExpandChip8Rows(const uint64_t* rows, uint32_t first, uint32_t count, uint32_t* pixels, uint32_t on, uint32_t off);
+
+// pulls the next run of consecutive dirty rows out of *dirty (lowest row first),
+// returns 0 once there are none left
+int NextChip8DirtyRun(uint64_t* dirty, uint32_t* first, uint32_t* count);
+
+#endif
@@ -2,43 +2,181 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
 
 #include "Chip8.h"
+#include "Chip8Display.h"
+#include "Chip8Scheduler.h"
+#include "Chip8Rewind.h"
+#include "Chip8Input.h"
+#include "Chip8Profile.h"
+#include "Chip8Tracer.h"
+#include "Chip8Rom.h"
+#include "Chip8Audio.h"
+#include "Chip8Frames.h"
+
+#define AUDIO_RING_SAMPLES 4096 // about 85ms at 48kHz, the most the ring can lag behind
+#define AUDIO_DEVICE_SAMPLES 512 // asked of SDL per callback
+
+// The emulator runs on a thread of its own and SDL keeps the main one: the
+// emulator publishes every finished frame through a Chip8FrameBuffer and reads
+// the keypad from an atomic mask, so a slow present or a stalled event loop
+// costs dropped frames on screen, never emulated time.
+typedef struct Emulator
+{
+	Chip8State* chip8;
+	Chip8Scheduler sched;
+	Chip8Rewind* rewind;
+	Chip8Replay* replay;
+	Chip8Recorder* recorder;
+	Chip8Profile* profile;
+	Chip8Tracer* tracer;
+	Chip8Audio audio;
+	Chip8AudioRing* audio_ring; // NULL without an audio device
+
+	// all the SDL thread touches while the emulator is running
+	Chip8FrameBuffer frames;
+	_Atomic uint16_t keys; // bit n is key n
+	_Atomic uint64_t keys_time; // when keys last changed (NowNs), 0 before any key
+	atomic_int rewinding;
+	atomic_int trace_toggles; // F9 presses the emulator hasn't acted on yet
+	atomic_int quit;
+} Emulator;
+
+void* RunEmulator(void* arg);
+void PresentFrame(const Chip8Frame* frame, Chip8Frame* shown, SDL_Renderer* render, SDL_Texture** textures, uint32_t* pixels);
+uint64_t NowNs(void);
+int MapKey(int sym);
+void FillAudio(void* userdata, uint8_t* stream, int len);
 
 // Will emulate chip8 given a ROM file
 // TODO: add in an option for disassembler, maybe through a flag
 int main(int argc, char** argv)
 {
+	uint32_t instructions_per_frame = CHIP8_DEFAULT_INSTRUCTIONS_PER_FRAME;
+	const char* trace_path = NULL;
+	int profiling = 0;
+	const char* record_path = NULL;
+	const char* replay_path = NULL;
+	uint8_t quirks = 0;
+	int measure_latency = 0;
+	int ipf_given = 0;
+	int quirks_given = 0;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "s:t:Po:p:SQ:L")) != -1)
+	{
+		switch (opt)
+		{
+			case 's': instructions_per_frame = strtoul(optarg, NULL, 0); ipf_given = 1; break;
+			case 't': trace_path = optarg; break;
+			case 'P': profiling = 1; break;
+			case 'o': record_path = optarg; break;
+			case 'p': replay_path = optarg; break;
+			case 'S': quirks = CHIP8_PROFILE_SCHIP; quirks_given = 1; break;
+			case 'Q':
+				if (!FindChip8Profile(optarg, &quirks))
+				{
+					printf("ERROR: Unknown quirk profile \"%s\" (chip8, vip or schip)\n", optarg);
+					exit(1);
+				}
+				quirks_given = 1;
+				break;
+			case 'L': measure_latency = 1; break;
+			default:
+				{
+					printf("USAGE: chip8 [-s instructions per frame] [-t execution trace to write] [-P] [-o input log to record | -p input log to replay] [-S | -Q chip8|vip|schip] [-L] [chip-8 ROM file]\n");
+					exit(1);
+				}
+		}
+	}
+
 	// usage nagger
-	if (argc != 2) 
+	if (optind != argc - 1 || !instructions_per_frame || (record_path && replay_path))
 	{
-		printf("USAGE: chip8 [chip-8 ROM file]\n");
+		printf("USAGE: chip8 [-s instructions per frame] [-t execution trace to write] [-P] [-o input log to record | -p input log to replay] [-S | -Q chip8|vip|schip] [-L] [chip-8 ROM file]\n");
 		exit(1);	
 	}
 
-	// open target ROM file
-	FILE* f = fopen(argv[1], "r");
-	if (!f)
+	// a log plays back with the frame length and quirks it was recorded with,
+	// asking for different ones would just make it go its own way
+	Chip8Replay* replay = NULL;
+	if (replay_path)
 	{
-		printf("ERROR: Could not open \"%s\"\n", argv[1]);
+		if (!(replay = LoadChip8Replay(replay_path)))
+		{
+			printf("ERROR: \"%s\" is not an input log\n", replay_path);
+			exit(1);
+		}
+		if (Chip8ReplayInstructionsPerFrame(replay)) // version 1 logs didn't keep them
+		{
+			if ((ipf_given && instructions_per_frame != Chip8ReplayInstructionsPerFrame(replay)) ||
+				(quirks_given && quirks != Chip8ReplayQuirks(replay)))
+			{
+				printf("ERROR: \"%s\" was recorded at %u instructions per frame with quirks %02x\n", replay_path,
+					Chip8ReplayInstructionsPerFrame(replay), Chip8ReplayQuirks(replay));
+				exit(1);
+			}
+			instructions_per_frame = Chip8ReplayInstructionsPerFrame(replay);
+			quirks = Chip8ReplayQuirks(replay);
+		}
+	}
+
+	// map target ROM file
+	Chip8Rom rom;
+	if (!MapChip8Rom(argv[optind], &rom))
+	{
+		printf("ERROR: \"%s\" is not a valid chip-8 ROM\n", argv[optind]);
 		exit(1);
 	}
-	
-	
-	// determine file size
-	fseek(f, 0L, SEEK_END);
-	int fsize = ftell(f);
-	fseek(f, 0L, SEEK_SET);
 
 	// create chip-8 and load ROM into it
 	Chip8State* chip8 = InitChip8();
-	fread(chip8->memory + 0x200, fsize, 1, f);
-	fclose(f);
+	EnableChip8DecodeCache(chip8);
+	SetChip8Quirks(chip8, quirks);
+	LoadChip8Program(chip8, rom.data, rom.size);
+	UnmapChip8Rom(&rom);
+
+	// a replay brings its own seed, anything else gets a fresh one (kept in the log when recording)
+	Chip8Recorder* recorder = NULL;
+	uint32_t seed = time(NULL);
+	if (replay)
+	{
+		seed = Chip8ReplaySeed(replay);
+	}
+	else if (record_path)
+	{
+		recorder = InitChip8Recorder(seed, instructions_per_frame, quirks);
+	}
+	SeedChip8Random(chip8, seed);
+
+	// -P reports where the time went once the window is closed
+	Chip8Profile* profile = NULL;
+	if (profiling)
+	{
+		profile = InitChip8Profile();
+		SetChip8Profiling(profile, chip8, 1);
+	}
+
+	// -t records every instruction to a file from the start, F9 pauses and resumes it
+	Chip8Tracer* tracer = NULL;
+	if (trace_path)
+	{
+		if (!(tracer = InitChip8Tracer(trace_path)))
+		{
+			printf("ERROR: Could not create \"%s\"\n", trace_path);
+			exit(1);
+		}
+		SetChip8Tracing(tracer, chip8, 1);
+	}
 
 	// user interface setup
 	SDL_Window* window;
-	SDL_Init(SDL_INIT_VIDEO);
+	SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO);
 	window = SDL_CreateWindow("Chip8Emu", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, 640, 480, SDL_WINDOW_OPENGL);
 
 	if (!window)
@@ -48,16 +186,78 @@ int main(int argc, char** argv)
 	}
 
 	SDL_Renderer* render = SDL_CreateRenderer(window, -1, SDL_RENDERER_SOFTWARE);
-	SDL_Texture* texture = SDL_CreateTexture(render, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC, 64, 32);
+	SDL_Texture* textures[2] = // 64x32, and 128x64 for SUPER-CHIP's high-res mode
+	{
+		SDL_CreateTexture(render, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC, CHIP8_DISPLAY_WIDTH, CHIP8_DISPLAY_HEIGHT),
+		SDL_CreateTexture(render, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC, CHIP8_HIRES_WIDTH, CHIP8_HIRES_HEIGHT),
+	};
+
+	// initializing chip8 display, both textures start out blank like 'shown' says
+	uint32_t pixels[CHIP8_HIRES_WIDTH * CHIP8_HIRES_HEIGHT]; // big enough for either mode
+	Chip8Frame shown;
+	memset(&shown, 0, sizeof(shown));
+	ExpandChip8Rows(shown.hires_display[0], 0, CHIP8_HIRES_HEIGHT * 2, pixels, 0xffffffff, 0xff000000);
+	SDL_UpdateTexture(textures[0], NULL, pixels, CHIP8_DISPLAY_WIDTH * sizeof(uint32_t));
+	SDL_UpdateTexture(textures[1], NULL, pixels, CHIP8_HIRES_WIDTH * sizeof(uint32_t));
+
+	// sound is made a frame at a time along with everything else and handed to SDL's
+	// audio thread through a ring, so the emulator never waits on the audio device
+	Chip8Audio audio;
+	InitChip8Audio(&audio, CHIP8_AUDIO_SAMPLE_RATE);
+	Chip8AudioRing* audio_ring = InitChip8AudioRing(AUDIO_RING_SAMPLES);
+	SDL_AudioSpec want, have;
+	memset(&want, 0, sizeof(want));
+	want.freq = CHIP8_AUDIO_SAMPLE_RATE;
+	want.format = AUDIO_S16SYS;
+	want.channels = 1;
+	want.samples = AUDIO_DEVICE_SAMPLES;
+	want.callback = FillAudio;
+	want.userdata = audio_ring;
+	SDL_AudioDeviceID audio_device = SDL_OpenAudioDevice(NULL, 0, &want, &have, 0); // SDL converts if it has to
+	if (!audio_device)
+	{
+		printf("WARNING: No sound, could not open an audio device\n%s\n", SDL_GetError());
+	}
+	else
+	{
+		SDL_PauseAudioDevice(audio_device, 0);
+	}
+
+	Emulator emu;
+	emu.chip8 = chip8;
+	InitChip8Scheduler(&emu.sched, instructions_per_frame, 1); // throttled to 60 frames per second
+	emu.replay = replay;
+	emu.recorder = recorder;
+	emu.profile = profile;
+	emu.tracer = tracer;
+	emu.audio = audio;
+	emu.audio_ring = audio_device ? audio_ring : NULL;
 
-	// initializing chip8 display
-	uint32_t pixels[64 * 32];
-	int i;
-	for (i = 0; i < 64 * 32; i++)
+	// holding backspace steps back through the last few minutes, one frame per frame
+	emu.rewind = InitChip8Rewind(CHIP8_REWIND_DEFAULT_BUDGET);
+	PushChip8Rewind(emu.rewind, chip8);
+
+	InitChip8FrameBuffer(&emu.frames);
+	atomic_init(&emu.keys, 0);
+	atomic_init(&emu.keys_time, 0);
+	atomic_init(&emu.rewinding, 0);
+	atomic_init(&emu.trace_toggles, 0);
+	atomic_init(&emu.quit, 0);
+
+	pthread_t emulator;
+	if (pthread_create(&emulator, NULL, RunEmulator, &emu) != 0)
 	{
-		pixels[i] = 0xff000000;
+		printf("ERROR: Could not start the emulator thread\n");
+		exit(1);
 	}
 
+	// -L times every key change from its event to the first frame that ran with it
+	// being presented (as far as SDL_RenderPresent returning, the rest is up to the screen)
+	uint64_t latency_count = 0;
+	uint64_t latency_total = 0;
+	uint64_t latency_max = 0;
+	uint64_t shown_keys_time = 0;
+	uint16_t keys = 0;
 
 	int quit = 0;	
 	while(!quit)
@@ -66,42 +266,266 @@ int main(int argc, char** argv)
 		while (SDL_PollEvent(&e) != 0) // poll & handle all events before continuing
 		{
 			if (e.type == SDL_QUIT) {quit = 1;} // this only handles pressing 'x' on the window
+			if (e.type == SDL_KEYDOWN || e.type == SDL_KEYUP)
+			{
+				if (e.key.keysym.sym == SDLK_BACKSPACE)
+				{
+					atomic_store(&emu.rewinding, e.type == SDL_KEYDOWN);
+				}
+				if (e.key.keysym.sym == SDLK_F9 && e.type == SDL_KEYDOWN && !e.key.repeat && tracer)
+				{
+					atomic_fetch_add(&emu.trace_toggles, 1);
+				}
+				int key = MapKey(e.key.keysym.sym);
+				uint16_t changed = (key < 0) ? keys : (e.type == SDL_KEYDOWN) ? (keys | (1 << key)) : (keys & ~(1 << key));
+				if (changed != keys)
+				{
+					// keys first: an emulator that sees the new time sees the new keys too,
+					// so a frame is never credited with a key change it didn't run with
+					keys = changed;
+					atomic_store(&emu.keys, keys);
+					atomic_store(&emu.keys_time, NowNs());
+				}
+			}
+		}
+
+		const Chip8Frame* frame = LatestChip8Frame(&emu.frames);
+		if (!frame)
+		{
+			SDL_Delay(1); // the emulator hasn't finished one since, don't spin
+			continue;
 		}
+		PresentFrame(frame, &shown, render, textures, pixels);
+
+		if (frame->keys_time != shown_keys_time) // the first frame with new keys is on screen
+		{
+			uint64_t latency = NowNs() - frame->keys_time;
+			latency_count++;
+			latency_total += latency;
+			latency_max = (latency > latency_max) ? latency : latency_max;
+			shown_keys_time = frame->keys_time;
+		}
+	}
+
+	atomic_store(&emu.quit, 1);
+	pthread_join(emulator, NULL); // everything below has the emulator's state to itself
+	if (measure_latency)
+	{
+		if (latency_count)
+		{
+			printf("input latency: %llu key changes, %.2f ms average, %.2f ms worst\n", (unsigned long long)latency_count,
+				latency_total / (latency_count * 1e6), latency_max / 1e6);
+		}
+		else
+		{
+			printf("input latency: no key changes\n");
+		}
+	}
 
-		printf("PC:%04x, I:%03x, V0:%02x, V1:%02x, INST:%02x%02x\n", chip8->PC, chip8->I, chip8->V[0], chip8->V[1], chip8->memory[chip8->PC], chip8->memory[chip8->PC + 1]);
-		EmulateChip8Operation(chip8);
-		SDL_Delay(1000);
-		
-		//SDL_SetRenderDrawColor(render, 0, 0, 0, 255);
-		//SDL_RenderClear(render); // clear screen to background color
-		
-		// DO TEXTURE WRITING HERE
-
-		//printf("attempting to copy display from chip8 to SDL texture");
-		//uint8_t pixel;
-		//for (pixel = 0; pixel < 64 * 32; pixel++)
-		//{
-		//	uint8_t target = chip8->display[pixel/8] >> (7 - (pixel % 8)) & 0x1;
-		//	if (target) pixels[pixel] = 	0xffffffff;
-		//	else pixels[pixel] = 		0xff000000;
-		//}
-		// END TEXTURE WRITING HERE
-		
-		//printf("attempting to update sdl texture");
-		//SDL_UpdateTexture(texture, NULL, pixels, 64 * sizeof(uint32_t));
-		//printf("attempting to copy texture to screen");
-		//SDL_RenderCopy(render, texture, NULL, NULL);
-
-
-		//printf("attempting to present current framebuffer");
-		//SDL_RenderPresent(render);
-	}
-	
 	// cleanup
-	SDL_DestroyTexture(texture);
+	if (tracer && !DeleteChip8Tracer(tracer))
+	{
+		printf("ERROR: Could not write \"%s\"\n", trace_path);
+	}
+	if (profile)
+	{
+		ReportChip8Profile(profile, chip8, stdout, CHIP8_PROFILE_HOT_SPOTS);
+		DeleteChip8Profile(profile);
+	}
+	if (recorder)
+	{
+		if (!SaveChip8Recorder(recorder, record_path))
+		{
+			printf("ERROR: Could not write \"%s\"\n", record_path);
+		}
+		DeleteChip8Recorder(recorder);
+	}
+	if (replay)
+	{
+		DeleteChip8Replay(replay);
+	}
+	DeleteChip8Rewind(emu.rewind);
+	if (audio_device)
+	{
+		SDL_CloseAudioDevice(audio_device); // waits out the callback, the ring can go after this
+	}
+	DeleteChip8AudioRing(audio_ring);
+	SDL_DestroyTexture(textures[0]);
+	SDL_DestroyTexture(textures[1]);
 	SDL_DestroyRenderer(render);
 	SDL_DestroyWindow(window);
 	SDL_Quit();
 	DeleteChip8(chip8);
 	exit(1);
 }
+
+// the emulation thread: runs frames at 60Hz until told to quit, whatever the SDL
+// thread is up to, and publishes each one when it's done
+void* RunEmulator(void* arg)
+{
+	Emulator* emu = arg;
+	Chip8State* chip8 = emu->chip8;
+
+	while (!atomic_load(&emu->quit))
+	{
+		if (emu->tracer && (atomic_exchange(&emu->trace_toggles, 0) & 1))
+		{
+			SetChip8Tracing(emu->tracer, chip8, !Chip8Tracing(emu->tracer));
+		}
+		uint64_t keys_time = atomic_load(&emu->keys_time); // before keys, see main
+		uint16_t keys = atomic_load(&emu->keys);
+
+		if (atomic_load(&emu->rewinding) && !emu->replay)
+		{
+			if (RewindChip8(emu->rewind, chip8, 1) && emu->recorder)
+			{
+				TruncateChip8Recorder(emu->recorder, chip8->cycles); // what got rewound never happened
+			}
+			PublishChip8Frame(&emu->frames, chip8, keys_time);
+			WaitChip8Frame(&emu->sched); // time passes, the emulator doesn't
+			continue;
+		}
+
+		// keys only ever change between frames, unless a replay says otherwise
+		if (!emu->replay)
+		{
+			if (emu->recorder)
+			{
+				RecordChip8Keys(emu->recorder, chip8->cycles, keys);
+			}
+			SetChip8Keys(chip8, keys);
+		}
+		else
+		{
+			keys_time = 0; // the keyboard isn't what's driving it
+		}
+
+		// one frame: a batch of instructions, the timers tick, then wait for the next 60Hz boundary
+		if (emu->replay)
+		{
+			RunChip8Replay(emu->replay, chip8, emu->sched.instructions_per_frame, 0);
+		}
+		else if (emu->profile)
+		{
+			Chip8Run(chip8, emu->sched.instructions_per_frame, 0); // spins on Fx0A for real, so the wait gets counted
+		}
+		else
+		{
+			// if the ROM blocks on Fx0A the rest of the frame is just spent sleeping
+			StepChip8Frame(&emu->sched, chip8);
+		}
+		PublishChip8Frame(&emu->frames, chip8, keys_time); // the screen only sees finished frames
+		if (emu->audio_ring)
+		{
+			int16_t samples[CHIP8_AUDIO_MAX_FRAME_SAMPLES];
+			PushChip8Audio(emu->audio_ring, samples, RenderChip8AudioFrame(&emu->audio, chip8, samples));
+		}
+		EndChip8Frame(&emu->sched, chip8);
+		PushChip8Rewind(emu->rewind, chip8);
+	}
+	return NULL;
+}
+
+// uploads only the rows that differ from what the texture for the frame's mode already
+// holds ('shown', updated here), then shows that texture (both get stretched over the
+// whole window). diffing against the textures rather than the previous frame means
+// frames the SDL thread never picked up don't need tracking
+void PresentFrame(const Chip8Frame* frame, Chip8Frame* shown, SDL_Renderer* render, SDL_Texture** textures, uint32_t* pixels)
+{
+	SDL_Texture* texture = textures[frame->hires != 0];
+	uint64_t dirty = 0;
+	uint32_t row;
+	if (frame->hires)
+	{
+		for (row = 0; row < CHIP8_HIRES_HEIGHT; row++)
+		{
+			if (frame->hires_display[row][0] != shown->hires_display[row][0] || frame->hires_display[row][1] != shown->hires_display[row][1])
+			{
+				dirty |= 1ULL << row;
+			}
+		}
+		memcpy(shown->hires_display, frame->hires_display, sizeof(shown->hires_display));
+	}
+	else
+	{
+		for (row = 0; row < CHIP8_DISPLAY_HEIGHT; row++)
+		{
+			if (frame->display[row] != shown->display[row])
+			{
+				dirty |= 1ULL << row;
+			}
+		}
+		memcpy(shown->display, frame->display, sizeof(shown->display));
+	}
+
+	uint32_t first, count;
+	while (NextChip8DirtyRun(&dirty, &first, &count))
+	{
+		if (frame->hires)
+		{
+			// a 128 pixel row is two 64 pixel words back to back, so it expands as two rows
+			uint32_t* run = pixels + first * CHIP8_HIRES_WIDTH;
+			ExpandChip8Rows(frame->hires_display[0], first * 2, count * 2, run, 0xffffffff, 0xff000000);
+
+			SDL_Rect rect = { 0, first, CHIP8_HIRES_WIDTH, count };
+			SDL_UpdateTexture(texture, &rect, run, CHIP8_HIRES_WIDTH * sizeof(uint32_t));
+			continue;
+		}
+
+		uint32_t* run = pixels + first * CHIP8_DISPLAY_WIDTH;
+		ExpandChip8Rows(frame->display, first, count, run, 0xffffffff, 0xff000000);
+
+		SDL_Rect rect = { 0, first, CHIP8_DISPLAY_WIDTH, count };
+		SDL_UpdateTexture(texture, &rect, run, CHIP8_DISPLAY_WIDTH * sizeof(uint32_t));
+	}
+
+	SDL_RenderCopy(render, texture, NULL, NULL);
+	SDL_RenderPresent(render);
+}
+
+// monotonic nanoseconds
+uint64_t NowNs(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+// the usual layout, the left side of a qwerty keyboard stands in for the hex keypad
+//	1 2 3 C		1 2 3 4
+//	4 5 6 D		q w e r
+//	7 8 9 E		a s d f
+//	A 0 B F		z x c v
+int MapKey(int sym)
+{
+	switch (sym)
+	{
+		case SDLK_1: return 0x1;
+		case SDLK_2: return 0x2;
+		case SDLK_3: return 0x3;
+		case SDLK_4: return 0xc;
+		case SDLK_q: return 0x4;
+		case SDLK_w: return 0x5;
+		case SDLK_e: return 0x6;
+		case SDLK_r: return 0xd;
+		case SDLK_a: return 0x7;
+		case SDLK_s: return 0x8;
+		case SDLK_d: return 0x9;
+		case SDLK_f: return 0xe;
+		case SDLK_z: return 0xa;
+		case SDLK_x: return 0x0;
+		case SDLK_c: return 0xb;
+		case SDLK_v: return 0xf;
+	}
+	return -1;
+}
+
+// runs on SDL's audio thread: whatever the emulator has pushed so far, then silence
+// if it's behind (rewinding, or a slow frame)
+void FillAudio(void* userdata, uint8_t* stream, int len)
+{
+	int16_t* out = (int16_t*)stream;
+	uint32_t count = len / sizeof(int16_t);
+	uint32_t got = PullChip8Audio(userdata, out, count);
+	memset(out + got, 0, (count - got) * sizeof(int16_t));
+}
@@ -0,0 +1,258 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "Chip8.h"
+#include "Chip8Scheduler.h"
+#include "Chip8Farm.h"
+#include "Chip8Pool.h"
+
+// every worker starts out owning a contiguous range of job indices. it eats
+// its own range from the front, and once that's gone it takes the back half
+// of somebody else's. jobs are whole ROM runs, so a plain lock per queue costs nothing
+typedef struct FarmQueue
+{
+	pthread_mutex_t lock;
+	uint32_t head; // next job to run
+	uint32_t tail; // one past the last job
+} __attribute__((aligned(64))) FarmQueue; // one cache line each, workers hammer their own
+
+typedef struct Farm
+{
+	const Chip8FarmJob* jobs;
+	Chip8FarmResult* results;
+	FarmQueue* queues;
+	uint32_t workers;
+} Farm;
+
+typedef struct FarmWorker
+{
+	Farm* farm;
+	uint32_t index;
+	pthread_t thread;
+} FarmWorker;
+
+// takes up to 'max' job indices for 'self', stealing if its own queue is empty,
+// returns how many it got (0 once there's no work left anywhere)
+static uint32_t TakeJobs(Farm* farm, uint32_t self, uint32_t* batch, uint32_t max)
+{
+	FarmQueue* own = &farm->queues[self];
+	for (;;)
+	{
+		uint32_t n = 0;
+		pthread_mutex_lock(&own->lock);
+		while (n < max && own->head < own->tail)
+		{
+			batch[n++] = own->head++;
+		}
+		pthread_mutex_unlock(&own->lock);
+		if (n)
+		{
+			return n;
+		}
+
+		// out of work, go and steal the back half of the next worker that has some
+		uint32_t start = 0, end = 0;
+		uint32_t k;
+		for (k = 1; k < farm->workers && start == end; k++)
+		{
+			FarmQueue* victim = &farm->queues[(self + k) % farm->workers];
+			pthread_mutex_lock(&victim->lock);
+			uint32_t left = victim->tail - victim->head;
+			if (left)
+			{
+				end = victim->tail;
+				victim->tail -= (left + 1) / 2;
+				start = victim->tail;
+			}
+			pthread_mutex_unlock(&victim->lock);
+		}
+
+		if (start == end)
+		{
+			return 0;
+		}
+
+		pthread_mutex_lock(&own->lock);
+		own->head = start;
+		own->tail = end;
+		pthread_mutex_unlock(&own->lock);
+	}
+}
+
+static void FinishJob(Chip8State* state, Chip8FarmResult* result)
+{
+	result->hash = HashChip8State(state);
+	result->cycles = state->cycles;
+	memcpy(result->display, state->display, sizeof(result->display));
+	result->loaded = 1;
+}
+
+// runs a batch of jobs side by side, one frame of each in turn
+static void RunBatch(Farm* farm, Chip8Pool* pool, const uint32_t* batch, uint32_t n)
+{
+	Chip8State* states[CHIP8_FARM_SLOTS];
+	Chip8Scheduler scheds[CHIP8_FARM_SLOTS];
+	uint32_t active = 0;
+	uint32_t i;
+
+	for (i = 0; i < n; i++)
+	{
+		const Chip8FarmJob* job = &farm->jobs[batch[i]];
+		Chip8State* state = AcquireChip8(pool, job->initial); // never runs out, batches are at most CHIP8_FARM_SLOTS
+		states[i] = NULL;
+
+		if (!job->initial && !LoadChip8Program(state, job->rom, job->rom_size))
+		{
+			farm->results[batch[i]].loaded = 0;
+			ReleaseChip8(pool, state);
+			continue;
+		}
+		SetChip8Quirks(state, job->quirks);
+		SeedChip8Random(state, job->seed);
+		InitChip8Scheduler(&scheds[i], job->instructions_per_frame, 0); // unthrottled, timers run in emulated time
+		states[i] = state;
+		active++;
+	}
+
+	uint64_t frame;
+	for (frame = 0; active; frame++)
+	{
+		for (i = 0; i < n; i++)
+		{
+			Chip8State* state = states[i];
+			if (!state)
+			{
+				continue;
+			}
+
+			const Chip8FarmJob* job = &farm->jobs[batch[i]];
+			if (frame == job->frames)
+			{
+				FinishJob(state, &farm->results[batch[i]]);
+				ReleaseChip8(pool, state);
+				states[i] = NULL;
+				active--;
+				continue;
+			}
+
+			SetChip8Keys(state, (job->keys && frame < job->key_frames) ? job->keys[frame] : 0);
+			RunChip8Frame(&scheds[i], state);
+		}
+	}
+}
+
+static void* FarmWorkerMain(void* arg)
+{
+	FarmWorker* worker = arg;
+	Chip8Pool* pool = InitChip8Pool(CHIP8_FARM_SLOTS);
+	if (!pool)
+	{
+		return NULL;
+	}
+
+	uint32_t batch[CHIP8_FARM_SLOTS];
+	uint32_t n;
+	while ((n = TakeJobs(worker->farm, worker->index, batch, CHIP8_FARM_SLOTS)))
+	{
+		RunBatch(worker->farm, pool, batch, n);
+	}
+
+	DeleteChip8Pool(pool);
+	return NULL;
+}
+
+int RunChip8Farm(const Chip8FarmJob* jobs, uint32_t count, Chip8FarmResult* results, uint32_t threads)
+{
+	if (!threads)
+	{
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = cpus > 0 ? cpus : 1;
+	}
+	if (threads > count)
+	{
+		threads = count ? count : 1;
+	}
+
+	Farm farm;
+	farm.jobs = jobs;
+	farm.results = results;
+	farm.workers = threads;
+	farm.queues = aligned_alloc(64, threads * sizeof(FarmQueue));
+	FarmWorker* workers = calloc(threads, sizeof(FarmWorker));
+	if (!farm.queues || !workers)
+	{
+		free(farm.queues);
+		free(workers);
+		return 0;
+	}
+
+	// deal the jobs out in contiguous chunks, stealing evens out whatever this gets wrong
+	uint32_t i;
+	for (i = 0; i < threads; i++)
+	{
+		pthread_mutex_init(&farm.queues[i].lock, NULL);
+		farm.queues[i].head = (uint64_t)count * i / threads;
+		farm.queues[i].tail = (uint64_t)count * (i + 1) / threads;
+		workers[i].farm = &farm;
+		workers[i].index = i;
+	}
+
+	// the calling thread is worker 0
+	uint32_t started = 1;
+	for (i = 1; i < threads; i++)
+	{
+		if (pthread_create(&workers[i].thread, NULL, FarmWorkerMain, &workers[i]) != 0)
+		{
+			break; // the ones that did start will steal the rest
+		}
+		started++;
+	}
+	FarmWorkerMain(&workers[0]);
+
+	for (i = 1; i < started; i++)
+	{
+		pthread_join(workers[i].thread, NULL);
+	}
+	for (i = 0; i < threads; i++)
+	{
+		pthread_mutex_destroy(&farm.queues[i].lock);
+	}
+	free(farm.queues);
+	free(workers);
+	return 1;
+}
+
+int WriteChip8FarmResults(const char* path, const Chip8FarmJob* jobs, const Chip8FarmResult* results, uint32_t count)
+{
+	FILE* f = fopen(path, "w");
+	if (!f)
+	{
+		return 0;
+	}
+
+	uint32_t i;
+	for (i = 0; i < count; i++)
+	{
+		const Chip8FarmResult* r = &results[i];
+		fprintf(f, "%s %02x %08x ", jobs[i].name, jobs[i].quirks, jobs[i].seed);
+		if (!r->loaded)
+		{
+			fprintf(f, "not-loaded\n");
+			continue;
+		}
+
+		fprintf(f, "%llu %016llx", (unsigned long long)r->cycles, (unsigned long long)r->hash);
+		uint32_t row;
+		for (row = 0; row < CHIP8_DISPLAY_HEIGHT; row++)
+		{
+			fprintf(f, " %016llx", (unsigned long long)r->display[row]);
+		}
+		fprintf(f, "\n");
+	}
+
+	return fclose(f) == 0;
+}
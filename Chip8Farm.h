@@ -0,0 +1,47 @@
+#ifndef CHIP8FARM_H_
+#define CHIP8FARM_H_
+
+#include <stdint.h>
+
+#include "Chip8.h"
+
+// Runs a big batch of independent jobs (ROM x input script x quirks x seed)
+// on a pool of worker threads. Each worker runs a handful of instances at once
+// out of its own Chip8Pool, and idle workers steal jobs from busy ones.
+
+#define CHIP8_FARM_SLOTS 16 // instances each worker keeps in flight
+
+typedef struct Chip8FarmJob
+{
+	const char* name; // written to the results file as is, no spaces
+	const uint8_t* rom;
+	uint32_t rom_size;
+	const Chip8State* initial; // instance to start from with the ROM already loaded (see Chip8Rom.h), NULL loads rom instead
+	uint8_t quirks; // CHIP8_QUIRK_* flags
+	uint32_t seed; // for Cxkk
+	uint32_t instructions_per_frame;
+	uint64_t frames;
+
+	// input script: bitmask of the keys held during each frame (bit n is key n),
+	// every key is up once the script runs out; NULL for no input
+	const uint16_t* keys;
+	uint64_t key_frames;
+} Chip8FarmJob;
+
+typedef struct Chip8FarmResult
+{
+	uint64_t hash; // HashChip8State of the final state
+	uint64_t cycles; // instructions executed
+	uint64_t display[CHIP8_DISPLAY_HEIGHT]; // final framebuffer
+	int loaded; // 0 if the ROM didn't fit in memory, nothing else is valid then
+} Chip8FarmResult;
+
+// runs every job, results[n] ends up holding the outcome of jobs[n];
+// threads == 0 uses one worker per online CPU. returns 0 if the pool couldn't start
+int RunChip8Farm(const Chip8FarmJob* jobs, uint32_t count, Chip8FarmResult* results, uint32_t threads);
+
+// one line per job: name, quirks, seed, cycles, hash then the display rows in hex.
+// returns 0 if the file couldn't be written
+int WriteChip8FarmResults(const char* path, const Chip8FarmJob* jobs, const Chip8FarmResult* results, uint32_t count);
+
+#endif
@@ -0,0 +1,194 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "Chip8.h"
+#include "Chip8Scheduler.h"
+#include "Chip8Farm.h"
+#include "Chip8Rom.h"
+
+#define MAX_SCRIPTS 16
+
+typedef struct InputScript
+{
+	const char* name;
+	uint16_t* keys;
+	uint64_t frames;
+} InputScript;
+
+static int ReadScript(const char* path, InputScript* script);
+
+// Runs every ROM against every input script, with and without sprite wrapping
+// and for a range of random seeds, spread over all cores, and writes one
+// result line per run. Everything is unthrottled so results are repeatable
+int main(int argc, char** argv)
+{
+	uint64_t frames = 600;
+	uint32_t instructions_per_frame = CHIP8_DEFAULT_INSTRUCTIONS_PER_FRAME;
+	uint32_t threads = 0;
+	uint32_t seeds = 1;
+	const char* output = "farm_results.txt";
+	InputScript scripts[MAX_SCRIPTS];
+	uint32_t script_count = 0;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "f:s:t:n:k:o:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'f': frames = strtoull(optarg, NULL, 0); break;
+			case 's': instructions_per_frame = strtoul(optarg, NULL, 0); break;
+			case 't': threads = strtoul(optarg, NULL, 0); break;
+			case 'n': seeds = strtoul(optarg, NULL, 0); break;
+			case 'o': output = optarg; break;
+			case 'k':
+				if (script_count == MAX_SCRIPTS || !ReadScript(optarg, &scripts[script_count]))
+				{
+					printf("ERROR: Could not load input script \"%s\"\n", optarg);
+					exit(1);
+				}
+				script_count++;
+				break;
+			default:
+				{
+					printf("USAGE: farm [-f frames] [-s instructions per frame] [-t threads] [-n seeds] [-k input script]... [-o results file] [chip-8 ROM file]...\n");
+					exit(1);
+				}
+		}
+	}
+
+	// usage nagger
+	if (optind == argc || !instructions_per_frame || !seeds)
+	{
+		printf("USAGE: farm [-f frames] [-s instructions per frame] [-t threads] [-n seeds] [-k input script]... [-o results file] [chip-8 ROM file]...\n");
+		exit(1);
+	}
+
+	if (!script_count)
+	{
+		scripts[0].name = "-";
+		scripts[0].keys = NULL;
+		scripts[0].frames = 0;
+		script_count = 1;
+	}
+
+	static const uint8_t quirk_sets[] = { 0, CHIP8_QUIRK_WRAP_SPRITES };
+	uint32_t quirk_count = sizeof(quirk_sets) / sizeof(quirk_sets[0]);
+	uint32_t rom_count = argc - optind;
+	uint32_t count = rom_count * script_count * quirk_count * seeds;
+
+	Chip8FarmJob* jobs = calloc(count, sizeof(Chip8FarmJob));
+	Chip8FarmResult* results = calloc(count, sizeof(Chip8FarmResult));
+	char** names = calloc(count, sizeof(char*));
+
+	// the same ROM passed more than once (say under two names) is only mapped and prepared once
+	Chip8RomCache* roms = InitChip8RomCache();
+	if (!roms)
+	{
+		printf("ERROR: Could not create the ROM cache\n");
+		exit(1);
+	}
+
+	uint32_t n = 0;
+	uint32_t r, s, q, seed;
+	for (r = 0; r < rom_count; r++)
+	{
+		const char* path = argv[optind + r];
+		const Chip8Rom* rom = OpenChip8Rom(roms, path);
+		if (!rom)
+		{
+			printf("ERROR: Could not read \"%s\" (or it's bigger than %d bytes)\n", path, CHIP8_MAX_ROM_SIZE);
+			exit(1);
+		}
+
+		const char* base = strrchr(path, '/');
+		base = base ? base + 1 : path;
+
+		for (s = 0; s < script_count; s++)
+		{
+			for (q = 0; q < quirk_count; q++)
+			{
+				for (seed = 1; seed <= seeds; seed++)
+				{
+					Chip8FarmJob* job = &jobs[n];
+					names[n] = malloc(strlen(base) + strlen(scripts[s].name) + 2);
+					sprintf(names[n], "%s:%s", base, scripts[s].name);
+					job->name = names[n];
+					job->rom = rom->data;
+					job->rom_size = rom->size;
+					job->initial = rom->initial;
+					job->quirks = quirk_sets[q];
+					job->seed = seed;
+					job->instructions_per_frame = instructions_per_frame;
+					job->frames = frames;
+					job->keys = scripts[s].keys;
+					job->key_frames = scripts[s].frames;
+					n++;
+				}
+			}
+		}
+	}
+
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if (!RunChip8Farm(jobs, count, results, threads))
+	{
+		printf("ERROR: Could not start the worker threads\n");
+		exit(1);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	DeleteChip8RomCache(roms); // the jobs' ROMs aren't needed past this point
+	double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+	if (!WriteChip8FarmResults(output, jobs, results, count))
+	{
+		printf("ERROR: Could not write \"%s\"\n", output);
+		exit(1);
+	}
+
+	uint64_t total = 0;
+	uint32_t i;
+	for (i = 0; i < count; i++)
+	{
+		total += results[i].cycles;
+	}
+
+	printf("jobs: %u\n", count);
+	printf("instructions: %llu\n", (unsigned long long)total);
+	printf("elapsed: %.6f s\n", elapsed);
+	printf("speed: %.0f instructions/s\n", elapsed > 0 ? total / elapsed : 0.0);
+	return 0;
+}
+
+// input scripts are text, one hex bitmask of held keys per frame (bit n is key n)
+static int ReadScript(const char* path, InputScript* script)
+{
+	FILE* f = fopen(path, "r");
+	if (!f)
+	{
+		return 0;
+	}
+
+	uint64_t capacity = 256;
+	script->keys = malloc(capacity * sizeof(uint16_t));
+	script->frames = 0;
+
+	unsigned int mask;
+	while (fscanf(f, "%x", &mask) == 1)
+	{
+		if (script->frames == capacity)
+		{
+			capacity *= 2;
+			script->keys = realloc(script->keys, capacity * sizeof(uint16_t));
+		}
+		script->keys[script->frames++] = mask;
+	}
+	fclose(f);
+
+	const char* base = strrchr(path, '/');
+	script->name = base ? base + 1 : path;
+	return 1;
+}
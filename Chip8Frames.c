@@ -0,0 +1,46 @@
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#include "Chip8.h"
+#include "Chip8Frames.h"
+
+void InitChip8FrameBuffer(Chip8FrameBuffer* frames)
+{
+	memset(frames->slots, 0, sizeof(frames->slots));
+	frames->back = 0;
+	atomic_init(&frames->middle, 1); // not fresh, there's nothing in it yet
+	frames->front = 2;
+	frames->published = 0;
+}
+
+void PublishChip8Frame(Chip8FrameBuffer* frames, const Chip8State* state, uint64_t keys_time)
+{
+	Chip8Frame* frame = &frames->slots[frames->back];
+	memcpy(frame->display, state->display, sizeof(frame->display));
+	frame->hires = state->hires;
+	if (state->hires)
+	{
+		memcpy(frame->hires_display, state->hires_display, sizeof(frame->hires_display));
+	}
+	frame->number = frames->published++;
+	frame->keys_time = keys_time;
+
+	// release so the copy above is visible before the slot is, and whatever was in
+	// the middle (read or not) is the next one to overwrite
+	uint32_t old = atomic_exchange_explicit(&frames->middle, frames->back | CHIP8_FRAME_FRESH, memory_order_acq_rel);
+	frames->back = old & ~CHIP8_FRAME_FRESH;
+}
+
+const Chip8Frame* LatestChip8Frame(Chip8FrameBuffer* frames)
+{
+	if (!(atomic_load_explicit(&frames->middle, memory_order_relaxed) & CHIP8_FRAME_FRESH))
+	{
+		return NULL;
+	}
+
+	// only the emulator can set fresh again, so the slot that comes back is the newest frame
+	uint32_t old = atomic_exchange_explicit(&frames->middle, frames->front, memory_order_acq_rel);
+	frames->front = old & ~CHIP8_FRAME_FRESH;
+	return &frames->slots[frames->front];
+}
@@ -0,0 +1,48 @@
+#ifndef CHIP8FRAMES_H_
+#define CHIP8FRAMES_H_
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "Chip8.h"
+
+// Hands finished frames from the thread running the emulator to the one showing
+// them, without either ever waiting on the other: a triple buffer. The emulator
+// always has a slot of its own to fill, the display always has one to read, and
+// the third sits in between holding the newest frame nobody has picked up yet.
+// Publishing swaps the emulator's slot with the middle one, picking up swaps the
+// display's. A display that falls behind just skips frames, one that's ahead
+// gets told there's nothing new. One producer and one consumer only.
+
+typedef struct Chip8Frame
+{
+	uint64_t display[CHIP8_DISPLAY_HEIGHT];
+	uint64_t hires_display[CHIP8_HIRES_HEIGHT][2]; // only copied while hires is on
+	uint8_t hires;
+	uint64_t number; // frames published before this one
+	uint64_t keys_time; // passed through from the publisher, see PublishChip8Frame
+} Chip8Frame;
+
+typedef struct Chip8FrameBuffer
+{
+	Chip8Frame slots[3];
+	_Atomic uint32_t middle __attribute__((aligned(64))); // slot index, | CHIP8_FRAME_FRESH while it's unread
+	uint32_t back __attribute__((aligned(64))); // the emulator's slot
+	uint64_t published;
+	uint32_t front __attribute__((aligned(64))); // the display's slot
+} Chip8FrameBuffer;
+
+#define CHIP8_FRAME_FRESH 0x4
+
+void InitChip8FrameBuffer(Chip8FrameBuffer* frames);
+
+// copies state's display into the emulator's slot and makes it the newest frame.
+// keys_time goes along with it untouched, the frontend uses it to time key
+// presses from the event to the first frame drawn with them
+void PublishChip8Frame(Chip8FrameBuffer* frames, const Chip8State* state, uint64_t keys_time);
+
+// the newest frame, or NULL if nothing was published since the last call. it
+// stays valid (and unchanged) until the next call that doesn't return NULL
+const Chip8Frame* LatestChip8Frame(Chip8FrameBuffer* frames);
+
+#endif
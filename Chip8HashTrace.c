@@ -0,0 +1,92 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "Chip8.h"
+#include "Chip8HashTrace.h"
+
+#define HEADER_SIZE 12
+
+int OpenChip8HashTrace(Chip8HashTrace* trace, const char* path, uint32_t instructions_per_frame)
+{
+	trace->frames = 0;
+	trace->file = fopen(path, "wb");
+	if (!trace->file)
+	{
+		return 0;
+	}
+
+	uint8_t header[HEADER_SIZE] = { 'C', '8', 'F', 'H', CHIP8_HASH_TRACE_VERSION, 0, 0, 0 };
+	header[8] = instructions_per_frame;
+	header[9] = instructions_per_frame >> 8;
+	header[10] = instructions_per_frame >> 16;
+	header[11] = instructions_per_frame >> 24;
+	fwrite(header, 1, HEADER_SIZE, trace->file);
+	return 1;
+}
+
+void WriteChip8HashTrace(Chip8HashTrace* trace, const Chip8State* state)
+{
+	uint64_t hash = HashChip8Frame(state);
+	uint8_t bytes[8];
+	int i;
+	for (i = 0; i < 8; i++)
+	{
+		bytes[i] = hash >> (8 * i);
+	}
+	fwrite(bytes, 1, 8, trace->file); // stdio buffers these, nothing hits the disk per frame
+	trace->frames++;
+}
+
+int CloseChip8HashTrace(Chip8HashTrace* trace)
+{
+	int ok = !ferror(trace->file);
+	return (fclose(trace->file) == 0) && ok;
+}
+
+int LoadChip8HashTrace(const char* path, uint64_t** hashes, uint64_t* frames, uint32_t* instructions_per_frame)
+{
+	FILE* f = fopen(path, "rb");
+	if (!f)
+	{
+		return 0;
+	}
+
+	fseek(f, 0L, SEEK_END);
+	long fsize = ftell(f);
+	fseek(f, 0L, SEEK_SET);
+
+	uint8_t header[HEADER_SIZE];
+	if (fsize < HEADER_SIZE || (fsize - HEADER_SIZE) % 8 != 0 || fread(header, 1, HEADER_SIZE, f) != HEADER_SIZE ||
+		memcmp(header, "C8FH", 4) != 0 || header[4] != CHIP8_HASH_TRACE_VERSION)
+	{
+		fclose(f);
+		return 0;
+	}
+
+	*frames = (fsize - HEADER_SIZE) / 8;
+	*instructions_per_frame = header[8] | (header[9] << 8) | (header[10] << 16) | ((uint32_t)header[11] << 24);
+	*hashes = malloc(*frames ? *frames * 8 : 1);
+
+	uint8_t bytes[8];
+	uint64_t n;
+	for (n = 0; n < *frames; n++)
+	{
+		if (fread(bytes, 1, 8, f) != 8)
+		{
+			free(*hashes);
+			fclose(f);
+			return 0;
+		}
+		uint64_t hash = 0;
+		int i;
+		for (i = 0; i < 8; i++)
+		{
+			hash |= (uint64_t)bytes[i] << (8 * i);
+		}
+		(*hashes)[n] = hash;
+	}
+	fclose(f);
+	return 1;
+}
@@ -0,0 +1,34 @@
+#ifndef CHIP8HASHTRACE_H_
+#define CHIP8HASHTRACE_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "Chip8.h"
+
+// Golden traces: one HashChip8Frame per frame, so two runs of a ROM + input log
+// can be compared without keeping any frames around. The file is "C8FH", a
+// version byte, 3 unused bytes and the u32 instructions per frame, then a u64
+// hash per frame, all little-endian.
+
+#define CHIP8_HASH_TRACE_VERSION 1
+
+typedef struct Chip8HashTrace
+{
+	FILE* file;
+	uint64_t frames;
+} Chip8HashTrace;
+
+// returns 0 if the file can't be created
+int OpenChip8HashTrace(Chip8HashTrace* trace, const char* path, uint32_t instructions_per_frame);
+
+// call once per frame, after the frame has ended (hash n is from the end of frame n, counting from 0)
+void WriteChip8HashTrace(Chip8HashTrace* trace, const Chip8State* state);
+
+// returns 0 if anything along the way failed to write
+int CloseChip8HashTrace(Chip8HashTrace* trace);
+
+// reads a whole trace, *hashes is malloc'd. returns 0 if it isn't a trace file
+int LoadChip8HashTrace(const char* path, uint64_t** hashes, uint64_t* frames, uint32_t* instructions_per_frame);
+
+#endif
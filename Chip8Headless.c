@@ -0,0 +1,408 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "Chip8.h"
+#include "Chip8Jit.h"
+#include "Chip8Scheduler.h"
+#include "Chip8Snapshot.h"
+#include "Chip8Rewind.h"
+#include "Chip8Input.h"
+#include "Chip8HashTrace.h"
+#include "Chip8Profile.h"
+#include "Chip8Tracer.h"
+#include "Chip8Rom.h"
+#include "Chip8Audio.h"
+
+void DumpChip8State(Chip8State* state);
+int RestoreSnapshot(Chip8State* state, const char* path);
+int WriteSnapshot(Chip8State* state, const char* path);
+
+// Runs a chip-8 ROM without any user interface for a fixed amount of
+// instructions (or frames) as fast as the host allows, then dumps the final state.
+// Timers tick in emulated time (once every 'instructions per frame'), so runs are repeatable
+int main(int argc, char** argv)
+{
+	uint64_t max_instructions = 0;
+	uint64_t max_frames = 0;
+	uint32_t instructions_per_frame = CHIP8_DEFAULT_INSTRUCTIONS_PER_FRAME;
+	int quiet = 0;
+	int cache = 0;
+	int jit = 0;
+	const char* restore = NULL;
+	const char* save = NULL;
+	uint64_t rewind_frames = 0;
+	const char* replay_path = NULL;
+	const char* trace_path = NULL;
+	int profiling = 0;
+	const char* exec_trace_path = NULL;
+	uint8_t quirks = 0;
+	int ipf_given = 0;
+	int quirks_given = 0;
+	const char* wav_path = NULL;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "i:f:s:qcjr:w:b:p:H:Pt:SQ:a:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'i': max_instructions = strtoull(optarg, NULL, 0); break;
+			case 'f': max_frames = strtoull(optarg, NULL, 0); break;
+			case 's': instructions_per_frame = strtoul(optarg, NULL, 0); ipf_given = 1; break;
+			case 'q': quiet = 1; break;
+			case 'c': cache = 1; break;
+			case 'j': jit = 1; break;
+			case 'r': restore = optarg; break;
+			case 'w': save = optarg; break;
+			case 'b': rewind_frames = strtoull(optarg, NULL, 0); break;
+			case 'p': replay_path = optarg; break;
+			case 'H': trace_path = optarg; break;
+			case 'P': profiling = 1; break;
+			case 't': exec_trace_path = optarg; break;
+			case 'S': quirks = CHIP8_PROFILE_SCHIP; quirks_given = 1; break;
+			case 'a': wav_path = optarg; break;
+			case 'Q':
+				if (!FindChip8Profile(optarg, &quirks))
+				{
+					printf("ERROR: Unknown quirk profile \"%s\" (chip8, vip or schip)\n", optarg);
+					exit(1);
+				}
+				quirks_given = 1;
+				break;
+			default:
+				{
+					printf("USAGE: headless [-i instructions | -f frames] [-s instructions per frame] [-q] [-c] [-j (runs across frames unless -a, -H or -b need every one)] [-r snapshot to restore] [-w snapshot to write] [-b frames to rewind] [-p input log to replay] [-H frame hash trace to write] [-P] [-t execution trace to write] [-S | -Q chip8|vip|schip] [-a WAV file to write] [chip-8 ROM file]\n");
+					exit(1);
+				}
+		}
+	}
+
+	// usage nagger
+	if (optind != argc - 1 || (!max_instructions && !max_frames) || !instructions_per_frame)
+	{
+		printf("USAGE: headless [-i instructions | -f frames] [-s instructions per frame] [-q] [-c] [-j (runs across frames unless -a, -H or -b need every one)] [-r snapshot to restore] [-w snapshot to write] [-b frames to rewind] [-p input log to replay] [-H frame hash trace to write] [-P] [-t execution trace to write] [-S | -Q chip8|vip|schip] [-a WAV file to write] [chip-8 ROM file]\n");
+		exit(1);
+	}
+
+	// a log plays back with the frame length and quirks it was recorded with,
+	// asking for different ones would just make it go its own way
+	Chip8Replay* replay = NULL;
+	if (replay_path)
+	{
+		if (!(replay = LoadChip8Replay(replay_path)))
+		{
+			printf("ERROR: \"%s\" is not an input log\n", replay_path);
+			exit(1);
+		}
+		if (Chip8ReplayInstructionsPerFrame(replay)) // version 1 logs didn't keep them
+		{
+			if ((ipf_given && instructions_per_frame != Chip8ReplayInstructionsPerFrame(replay)) ||
+				(quirks_given && quirks != Chip8ReplayQuirks(replay)))
+			{
+				printf("ERROR: \"%s\" was recorded at %u instructions per frame with quirks %02x\n", replay_path,
+					Chip8ReplayInstructionsPerFrame(replay), Chip8ReplayQuirks(replay));
+				exit(1);
+			}
+			instructions_per_frame = Chip8ReplayInstructionsPerFrame(replay);
+			quirks = Chip8ReplayQuirks(replay);
+		}
+	}
+
+	if (max_frames)
+	{
+		max_instructions = max_frames * instructions_per_frame;
+	}
+
+	// map target ROM file
+	Chip8Rom rom;
+	if (!MapChip8Rom(argv[optind], &rom))
+	{
+		printf("ERROR: Could not read \"%s\" (or it's bigger than %d bytes)\n", argv[optind], CHIP8_MAX_ROM_SIZE);
+		exit(1);
+	}
+
+	// create chip-8 and load ROM into it
+	Chip8State* chip8 = InitChip8();
+	if (cache)
+	{
+		EnableChip8DecodeCache(chip8);
+	}
+	SetChip8Quirks(chip8, quirks);
+	LoadChip8Program(chip8, rom.data, rom.size);
+	UnmapChip8Rom(&rom);
+
+	if (replay)
+	{
+		SeedChip8Random(chip8, Chip8ReplaySeed(replay));
+	}
+	if (restore && !RestoreSnapshot(chip8, restore)) // carry on from a warmed up state instead of the start
+	{
+		printf("ERROR: Could not restore snapshot \"%s\"\n", restore);
+		exit(1);
+	}
+
+	Chip8Tracer* tracer = NULL;
+	if (exec_trace_path)
+	{
+		if (!(tracer = InitChip8Tracer(exec_trace_path)))
+		{
+			printf("ERROR: Could not create \"%s\"\n", exec_trace_path);
+			exit(1);
+		}
+		SetChip8Tracing(tracer, chip8, 1);
+	}
+
+	// profiling and tracing see every instruction as the interpreter runs it, so they win over -j
+	Chip8Profile* profile = NULL;
+	if (profiling)
+	{
+		profile = InitChip8Profile();
+		SetChip8Profiling(profile, chip8, 1);
+	}
+	Chip8Jit* recompiler = NULL;
+	if (jit && !profile && !tracer && !(recompiler = InitChip8Jit(chip8)))
+	{
+		printf("WARNING: recompiler not available, interpreting instead\n");
+	}
+
+	Chip8Scheduler sched;
+	InitChip8Scheduler(&sched, instructions_per_frame, 0); // unthrottled
+
+	Chip8HashTrace trace;
+	if (trace_path && !OpenChip8HashTrace(&trace, trace_path, instructions_per_frame))
+	{
+		printf("ERROR: Could not create \"%s\"\n", trace_path);
+		exit(1);
+	}
+
+	// -a writes the sound out a frame at a time, in emulated time like everything else
+	Chip8Audio audio;
+	Chip8Wav wav;
+	int16_t samples[CHIP8_AUDIO_MAX_FRAME_SAMPLES];
+	InitChip8Audio(&audio, CHIP8_AUDIO_SAMPLE_RATE);
+	if (wav_path && !OpenChip8Wav(&wav, wav_path, CHIP8_AUDIO_SAMPLE_RATE))
+	{
+		printf("ERROR: Could not create \"%s\"\n", wav_path);
+		exit(1);
+	}
+
+	// with -b every frame is recorded so the run can be stepped back at the end
+	Chip8Rewind* rewind = NULL;
+	if (rewind_frames)
+	{
+		rewind = InitChip8Rewind(CHIP8_REWIND_DEFAULT_BUDGET);
+		PushChip8Rewind(rewind, chip8);
+	}
+
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	uint64_t executed = 0;
+	if (recompiler && !wav_path && !trace_path && !rewind)
+	{
+		// nothing needs to see the end of each frame, so the recompiler ends them itself and
+		// its loops run natively across frame boundaries instead of a frame's worth at a time.
+		// frames count from the start of the run, like the batches below
+		chip8->frame_cycles = 0;
+		while (executed < max_instructions)
+		{
+			uint64_t run = max_instructions - executed;
+			if (replay) // keys change at exact cycles, stop at each one
+			{
+				ApplyChip8Replay(replay, chip8);
+				if (NextChip8ReplayCycle(replay) - chip8->cycles < run)
+				{
+					run = NextChip8ReplayCycle(replay) - chip8->cycles;
+				}
+			}
+			executed += RunChip8JitFrames(recompiler, &sched, run);
+		}
+	}
+	while (executed < max_instructions)
+	{
+		uint64_t batch = max_instructions - executed;
+		if (batch > instructions_per_frame)
+		{
+			batch = instructions_per_frame;
+		}
+
+		if (recompiler)
+		{
+			// the recompiler doesn't know about the replay, so cut the batch up at each key change
+			uint64_t done = 0;
+			while (done < batch)
+			{
+				uint64_t run = batch - done;
+				if (replay)
+				{
+					ApplyChip8Replay(replay, chip8);
+					if (NextChip8ReplayCycle(replay) - chip8->cycles < run)
+					{
+						run = NextChip8ReplayCycle(replay) - chip8->cycles;
+					}
+				}
+				done += RunChip8Jit(recompiler, run);
+			}
+		}
+		else if (replay)
+		{
+			RunChip8Replay(replay, chip8, batch, 0);
+		}
+		else
+		{
+			Chip8Run(chip8, batch, 0);
+		}
+		executed += batch;
+
+		if (batch == instructions_per_frame) // a partial last frame doesn't tick the timers
+		{
+			if (wav_path)
+			{
+				WriteChip8Wav(&wav, samples, RenderChip8AudioFrame(&audio, chip8, samples));
+			}
+			EndChip8Frame(&sched, chip8);
+			if (trace_path)
+			{
+				WriteChip8HashTrace(&trace, chip8);
+			}
+			if (rewind)
+			{
+				PushChip8Rewind(rewind, chip8);
+			}
+		}
+	}
+
+	if (tracer && !DeleteChip8Tracer(tracer))
+	{
+		printf("ERROR: Could not write \"%s\"\n", exec_trace_path);
+		exit(1);
+	}
+
+	if (trace_path && !CloseChip8HashTrace(&trace))
+	{
+		printf("ERROR: Could not write \"%s\"\n", trace_path);
+		exit(1);
+	}
+
+	if (wav_path && !CloseChip8Wav(&wav))
+	{
+		printf("ERROR: Could not write \"%s\"\n", wav_path);
+		exit(1);
+	}
+
+	uint64_t rewound = 0;
+	if (rewind)
+	{
+		rewound = RewindChip8(rewind, chip8, rewind_frames);
+		DeleteChip8Rewind(rewind);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+	if (!quiet)
+	{
+		DumpChip8State(chip8);
+	}
+
+	printf("instructions: %llu\n", (unsigned long long)executed);
+	printf("frames: %llu\n", (unsigned long long)sched.frames);
+	printf("elapsed: %.6f s\n", elapsed);
+	printf("speed: %.0f instructions/s\n", elapsed > 0 ? executed / elapsed : 0.0);
+	if (rewind_frames)
+	{
+		printf("rewound: %llu frames\n", (unsigned long long)rewound);
+	}
+
+	if (profile)
+	{
+		ReportChip8Profile(profile, chip8, stdout, CHIP8_PROFILE_HOT_SPOTS);
+		DeleteChip8Profile(profile);
+	}
+
+	if (save && !WriteSnapshot(chip8, save))
+	{
+		printf("ERROR: Could not write snapshot \"%s\"\n", save);
+		exit(1);
+	}
+
+	if (recompiler)
+	{
+		DeleteChip8Jit(recompiler);
+	}
+	if (replay)
+	{
+		DeleteChip8Replay(replay);
+	}
+	DeleteChip8(chip8);
+	return 0;
+}
+
+// prints registers followed by the 64x32 display, or the 128x64 one when it's on ('#' for a lit pixel)
+void DumpChip8State(Chip8State* state)
+{
+	printf("PC:%04x I:%03x SP:%02x DT:%02x ST:%02x\n", state->PC, state->I, state->SP, state->DT, state->ST);
+
+	int i;
+	for (i = 0; i < 16; i++)
+	{
+		printf("V%X:%02x%c", i, state->V[i], (i % 8 == 7) ? '\n' : ' ');
+	}
+
+	int x, y;
+	if (state->hires)
+	{
+		for (y = 0; y < CHIP8_HIRES_HEIGHT; y++)
+		{
+			char line[CHIP8_HIRES_WIDTH + 1];
+			for (x = 0; x < CHIP8_HIRES_WIDTH; x++)
+			{
+				line[x] = ((state->hires_display[y][x >> 6] >> (63 - (x & 63))) & 0x1) ? '#' : '.';
+			}
+			line[CHIP8_HIRES_WIDTH] = '\0';
+			printf("%s\n", line);
+		}
+		return;
+	}
+
+	for (y = 0; y < CHIP8_DISPLAY_HEIGHT; y++)
+	{
+		char line[CHIP8_DISPLAY_WIDTH + 1];
+		for (x = 0; x < CHIP8_DISPLAY_WIDTH; x++)
+		{
+			line[x] = ((state->display[y] >> (63 - x)) & 0x1) ? '#' : '.';
+		}
+		line[CHIP8_DISPLAY_WIDTH] = '\0';
+		printf("%s\n", line);
+	}
+}
+
+// loads a full snapshot file written by WriteSnapshot
+int RestoreSnapshot(Chip8State* state, const char* path)
+{
+	FILE* f = fopen(path, "rb");
+	if (!f)
+	{
+		return 0;
+	}
+	uint8_t buffer[CHIP8_SNAPSHOT_SIZE + 1];
+	size_t size = fread(buffer, 1, sizeof(buffer), f);
+	fclose(f);
+	return Chip8LoadState(state, NULL, buffer, size);
+}
+
+int WriteSnapshot(Chip8State* state, const char* path)
+{
+	uint8_t buffer[CHIP8_SNAPSHOT_SIZE];
+	size_t size = Chip8SaveState(state, NULL, buffer, sizeof(buffer));
+
+	FILE* f = fopen(path, "wb");
+	if (!f)
+	{
+		return 0;
+	}
+	size_t written = fwrite(buffer, 1, size, f);
+	return fclose(f) == 0 && written == size;
+}
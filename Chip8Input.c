@@ -0,0 +1,261 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "Chip8.h"
+#include "Chip8Input.h"
+
+#define HEADER_SIZE 14 // magic, version, seed, instructions per frame, quirks
+#define HEADER_SIZE_V1 9 // no settings yet
+
+struct Chip8Recorder
+{
+	uint8_t* data;
+	size_t size;
+	size_t capacity;
+	uint64_t last_cycle; // of the last event written
+	uint16_t last_keys;
+};
+
+struct Chip8Replay
+{
+	uint8_t* data;
+	size_t size;
+	size_t pos; // start of the event after 'next'
+	uint32_t seed;
+	uint32_t instructions_per_frame; // 0 in a version 1 log
+	uint8_t quirks;
+
+	uint64_t next_cycle; // UINT64_MAX when there are no more events
+	uint16_t next_keys;
+};
+
+static void PutVarint(Chip8Recorder* rec, uint64_t v)
+{
+	if (rec->capacity - rec->size < 10)
+	{
+		rec->capacity *= 2;
+		rec->data = realloc(rec->data, rec->capacity);
+	}
+	do
+	{
+		uint8_t b = v & 0x7f;
+		v >>= 7;
+		rec->data[rec->size++] = b | (v ? 0x80 : 0);
+	} while (v);
+}
+
+// returns 0 if the varint runs off the end of the log
+static int GetVarint(const uint8_t* data, size_t size, size_t* pos, uint64_t* v)
+{
+	*v = 0;
+	int shift;
+	for (shift = 0; shift < 64 && *pos < size; shift += 7)
+	{
+		uint8_t b = data[(*pos)++];
+		*v |= (uint64_t)(b & 0x7f) << shift;
+		if (!(b & 0x80))
+		{
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static void PutU32(uint8_t* p, uint32_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+static uint32_t GetU32(const uint8_t* p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+Chip8Recorder* InitChip8Recorder(uint32_t seed, uint32_t instructions_per_frame, uint8_t quirks)
+{
+	Chip8Recorder* rec = calloc(1, sizeof(Chip8Recorder));
+	rec->capacity = 256;
+	rec->data = malloc(rec->capacity);
+
+	memcpy(rec->data, "C8IN", 4);
+	rec->data[4] = CHIP8_INPUT_VERSION;
+	PutU32(rec->data + 5, seed);
+	PutU32(rec->data + 9, instructions_per_frame);
+	rec->data[13] = quirks;
+	rec->size = HEADER_SIZE;
+	return rec;
+}
+
+void DeleteChip8Recorder(Chip8Recorder* rec)
+{
+	free(rec->data);
+	free(rec);
+}
+
+void RecordChip8Keys(Chip8Recorder* rec, uint64_t cycles, uint16_t keys)
+{
+	if (keys == rec->last_keys)
+	{
+		return;
+	}
+	PutVarint(rec, cycles - rec->last_cycle);
+	PutVarint(rec, keys);
+	rec->last_cycle = cycles;
+	rec->last_keys = keys;
+}
+
+void TruncateChip8Recorder(Chip8Recorder* rec, uint64_t cycles)
+{
+	// walk the log from the start, events only record the distance to the one before
+	size_t pos = HEADER_SIZE;
+	uint64_t at = 0;
+	uint16_t keys = 0;
+	while (pos < rec->size)
+	{
+		size_t start = pos;
+		uint64_t delta, mask;
+		GetVarint(rec->data, rec->size, &pos, &delta);
+		GetVarint(rec->data, rec->size, &pos, &mask);
+		if (at + delta > cycles)
+		{
+			pos = start;
+			break;
+		}
+		at += delta;
+		keys = mask;
+	}
+	rec->size = pos;
+	rec->last_cycle = at;
+	rec->last_keys = keys;
+}
+
+int SaveChip8Recorder(const Chip8Recorder* rec, const char* path)
+{
+	FILE* f = fopen(path, "wb");
+	if (!f)
+	{
+		return 0;
+	}
+	size_t written = fwrite(rec->data, 1, rec->size, f);
+	return fclose(f) == 0 && written == rec->size;
+}
+
+// reads the event at replay->pos into next_cycle/next_keys
+static void ReadNextEvent(Chip8Replay* replay)
+{
+	uint64_t delta, keys;
+	if (replay->pos >= replay->size ||
+		!GetVarint(replay->data, replay->size, &replay->pos, &delta) ||
+		!GetVarint(replay->data, replay->size, &replay->pos, &keys))
+	{
+		replay->next_cycle = UINT64_MAX; // a cut off event counts as the end of the log
+		return;
+	}
+	replay->next_cycle += delta;
+	replay->next_keys = keys;
+}
+
+Chip8Replay* LoadChip8Replay(const char* path)
+{
+	FILE* f = fopen(path, "rb");
+	if (!f)
+	{
+		return NULL;
+	}
+	fseek(f, 0L, SEEK_END);
+	long fsize = ftell(f);
+	fseek(f, 0L, SEEK_SET);
+
+	// version 1 logs (no settings) still play, the frontend just can't check them
+	uint8_t* data = fsize >= HEADER_SIZE_V1 ? malloc(fsize) : NULL;
+	if (!data || fread(data, 1, fsize, f) != (size_t)fsize || memcmp(data, "C8IN", 4) != 0 ||
+		(data[4] != CHIP8_INPUT_VERSION && data[4] != 1) || (data[4] == CHIP8_INPUT_VERSION && fsize < HEADER_SIZE))
+	{
+		free(data);
+		fclose(f);
+		return NULL;
+	}
+	fclose(f);
+
+	Chip8Replay* replay = calloc(1, sizeof(Chip8Replay));
+	replay->data = data;
+	replay->size = fsize;
+	replay->seed = GetU32(data + 5);
+	if (data[4] == 1)
+	{
+		replay->pos = HEADER_SIZE_V1;
+	}
+	else
+	{
+		replay->instructions_per_frame = GetU32(data + 9);
+		replay->quirks = data[13];
+		replay->pos = HEADER_SIZE;
+	}
+	ReadNextEvent(replay);
+	return replay;
+}
+
+void DeleteChip8Replay(Chip8Replay* replay)
+{
+	free(replay->data);
+	free(replay);
+}
+
+uint32_t Chip8ReplaySeed(const Chip8Replay* replay)
+{
+	return replay->seed;
+}
+
+uint32_t Chip8ReplayInstructionsPerFrame(const Chip8Replay* replay)
+{
+	return replay->instructions_per_frame;
+}
+
+uint8_t Chip8ReplayQuirks(const Chip8Replay* replay)
+{
+	return replay->quirks;
+}
+
+uint64_t NextChip8ReplayCycle(const Chip8Replay* replay)
+{
+	return replay->next_cycle;
+}
+
+void ApplyChip8Replay(Chip8Replay* replay, Chip8State* state)
+{
+	while (replay->next_cycle <= state->cycles)
+	{
+		SetChip8Keys(state, replay->next_keys);
+		ReadNextEvent(replay);
+	}
+}
+
+Chip8RunResult RunChip8Replay(Chip8Replay* replay, Chip8State* state, uint64_t max_cycles, uint32_t stop_mask)
+{
+	Chip8RunResult total = { 0, 0 };
+	while (total.cycles < max_cycles)
+	{
+		ApplyChip8Replay(replay, state);
+
+		uint64_t run = max_cycles - total.cycles;
+		if (replay->next_cycle - state->cycles < run)
+		{
+			run = replay->next_cycle - state->cycles; // stop right where the keys change
+		}
+
+		Chip8RunResult result = Chip8Run(state, run, stop_mask);
+		total.cycles += result.cycles;
+		if (result.reason)
+		{
+			total.reason = result.reason;
+			break;
+		}
+	}
+	ApplyChip8Replay(replay, state);
+	return total;
+}
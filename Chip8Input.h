@@ -0,0 +1,56 @@
+#ifndef CHIP8INPUT_H_
+#define CHIP8INPUT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "Chip8.h"
+
+// Input recording and replay. A log is "C8IN", a version byte, the u32 rng
+// seed, the u32 instructions per frame and the u8 quirks it was recorded with
+// (little-endian), then one event per change of the keypad: the cycles since
+// the previous event and the new 16-bit key mask (bit n is key n), both as
+// LEB128 varints. Replaying a log from a fresh state with the same seed,
+// frame length and quirks reproduces the run exactly, at any speed and on any
+// machine. Version 1 logs have no frame length or quirks, they still load.
+
+#define CHIP8_INPUT_VERSION 2 // 2 added instructions per frame and quirks
+
+typedef struct Chip8Recorder Chip8Recorder;
+typedef struct Chip8Replay Chip8Replay;
+
+// starts an empty log, the caller seeds the state with the same seed
+Chip8Recorder* InitChip8Recorder(uint32_t seed, uint32_t instructions_per_frame, uint8_t quirks);
+void DeleteChip8Recorder(Chip8Recorder* rec);
+
+// logs the keys the host is about to hand to the state at 'cycles' (state->cycles),
+// nothing is written unless they changed
+void RecordChip8Keys(Chip8Recorder* rec, uint64_t cycles, uint16_t keys);
+
+// forgets events after 'cycles', for when the run is rewound
+void TruncateChip8Recorder(Chip8Recorder* rec, uint64_t cycles);
+
+// returns 0 if the file couldn't be written
+int SaveChip8Recorder(const Chip8Recorder* rec, const char* path);
+
+// NULL if the file can't be read or isn't an input log
+Chip8Replay* LoadChip8Replay(const char* path);
+void DeleteChip8Replay(Chip8Replay* replay);
+
+uint32_t Chip8ReplaySeed(const Chip8Replay* replay);
+
+// what the log was recorded with, the frontend has to run the same way.
+// instructions per frame is 0 for a version 1 log, which didn't keep them
+uint32_t Chip8ReplayInstructionsPerFrame(const Chip8Replay* replay);
+uint8_t Chip8ReplayQuirks(const Chip8Replay* replay);
+
+// cycle count of the next key change, UINT64_MAX once the log runs out
+uint64_t NextChip8ReplayCycle(const Chip8Replay* replay);
+
+// hands the state every key change due at state->cycles
+void ApplyChip8Replay(Chip8Replay* replay, Chip8State* state);
+
+// Chip8Run, but stopping at each logged key change to apply it
+Chip8RunResult RunChip8Replay(Chip8Replay* replay, Chip8State* state, uint64_t max_cycles, uint32_t stop_mask);
+
+#endif
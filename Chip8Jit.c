@@ -0,0 +1,718 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stddef.h>
+
+#include "Chip8.h"
+#include "Chip8Jit.h"
+#include "Chip8Scheduler.h"
+
+#if defined(__x86_64__) && defined(__linux__)
+
+#include <sys/mman.h>
+
+// A block is a run of instructions that only touch V0..VF, I and the PC
+// (6xkk, 7xkk, 8xy*, Annn), optionally ended by a jump or a skip (1nnn,
+// 3xkk, 4xkk, 5xy0, 9xy0) whose new PC is worked out without branching.
+// Guest registers used by a block are loaded into host registers on entry
+// and only the ones it changed get written back on exit. A block that ends
+// by jumping back to its own start loops natively until the budget runs out.
+// Anything else (draws, calls, keys, timers, memory access) is left to
+// EmulateChip8Operation, one instruction at a time.
+
+#define JIT_ARENA_SIZE (4 * 1024 * 1024)
+#define JIT_MAX_BLOCK_CODE 4096 // worst case size of one translated block
+#define JIT_MAX_BLOCK_INSTRUCTIONS 64
+
+typedef uint32_t (*Chip8JitCode)(Chip8State* state, uint32_t budget); // returns instructions executed
+
+enum
+{
+	BLOCK_UNKNOWN = 0, // never looked at, or thrown away after a write
+	BLOCK_COMPILED, // native code available
+	BLOCK_INTERPRET, // first instruction can't be translated
+};
+
+typedef struct Chip8JitBlock
+{
+	Chip8JitCode code;
+	uint16_t end; // first address after the block
+	uint8_t instructions;
+	uint8_t status;
+} Chip8JitBlock;
+
+struct Chip8Jit
+{
+	Chip8State* state;
+	uint8_t* arena; // executable memory, blocks are appended until it's full
+	uint32_t arena_used;
+	uint8_t quirks; // the state's quirks when the blocks below were translated
+	Chip8JitBlock blocks[0x1000]; // indexed by start address
+	uint8_t code_mark[0x1000]; // nonzero if the byte belongs to a compiled block
+};
+
+// host registers
+enum { RAX = 0, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 };
+
+// registers guest V's can live in (rdi holds the state, esi the instruction
+// budget, r11d the executed count and rax/rcx/rdx are scratch)
+static const uint8_t guest_pool[] = { R8, R9, R10, RBX, RBP, R12, R13, R14, R15 };
+#define GUEST_POOL_SIZE (sizeof(guest_pool) / sizeof(guest_pool[0]))
+
+static int IsCalleeSaved(uint8_t reg)
+{
+	return reg == RBX || reg == RBP || reg >= R12;
+}
+
+// ---- instruction classification ----
+
+enum
+{
+	JIT_NONE = 0, // can't be translated
+	JIT_BODY, // falls through to the next instruction
+	JIT_END, // decides the next PC itself, always last in a block
+};
+
+// works out if an opcode can be translated and which V registers it touches.
+// only the quirk-free behaviour gets translated, the rest goes to the interpreter
+static int ClassifyForJit(uint16_t opcode, uint8_t quirks, uint16_t* read, uint16_t* written)
+{
+	uint16_t x = 1 << ((opcode >> 8) & 0x0f);
+	uint16_t y = 1 << ((opcode >> 4) & 0x0f);
+	uint16_t vf = 1 << 15;
+	*read = 0;
+	*written = 0;
+
+	switch (opcode >> 12)
+	{
+		case 0x1: return JIT_END;
+		case 0x3: case 0x4: *read = x; return JIT_END;
+		case 0x5: case 0x9:
+			if (opcode & 0x0f) return JIT_NONE;
+			*read = x | y;
+			return JIT_END;
+		case 0x6: *written = x; return JIT_BODY;
+		case 0x7: *read = x; *written = x; return JIT_BODY;
+		case 0xa: return JIT_BODY;
+		case 0x8:
+			switch (opcode & 0x0f)
+			{
+				case 0x0: *read = y; *written = x; return JIT_BODY;
+				case 0x1: case 0x2: case 0x3:
+					if (quirks & CHIP8_QUIRK_VF_RESET) return JIT_NONE;
+					*read = x | y;
+					*written = x;
+					return JIT_BODY;
+				case 0x4: case 0x5: case 0x7: *read = x | y; *written = x | vf; return JIT_BODY;
+				case 0x6: case 0xe:
+					if (quirks & CHIP8_QUIRK_SHIFT_VY) return JIT_NONE;
+					*read = x;
+					*written = x | vf;
+					return JIT_BODY;
+			}
+			return JIT_NONE;
+	}
+	return JIT_NONE;
+}
+
+// ---- x86-64 encoding ----
+
+typedef struct Emitter
+{
+	uint8_t* p;
+} Emitter;
+
+static void Emit8(Emitter* e, uint8_t b)
+{
+	*e->p++ = b;
+}
+
+static void Emit16(Emitter* e, uint16_t v)
+{
+	Emit8(e, v & 0xff);
+	Emit8(e, v >> 8);
+}
+
+static void Emit32(Emitter* e, uint32_t v)
+{
+	Emit16(e, v & 0xffff);
+	Emit16(e, v >> 16);
+}
+
+static void EmitRex(Emitter* e, uint8_t reg, uint8_t rm, int force)
+{
+	uint8_t rex = 0x40 | ((reg >> 3) << 2) | (rm >> 3);
+	if (rex != 0x40 || force)
+	{
+		Emit8(e, rex);
+	}
+}
+
+// <op> r/m32, r32 (mov 89, add 01, or 09, and 21, sub 29, xor 31, cmp 39)
+static void EmitRegReg(Emitter* e, uint8_t op, uint8_t dst, uint8_t src)
+{
+	EmitRex(e, src, dst, 0);
+	Emit8(e, op);
+	Emit8(e, 0xc0 | ((src & 7) << 3) | (dst & 7));
+}
+
+// <op> r/m32, imm32 (add /0, or /1, and /4, sub /5, xor /6, cmp /7)
+static void EmitRegImm(Emitter* e, uint8_t ext, uint8_t dst, uint32_t imm)
+{
+	EmitRex(e, 0, dst, 0);
+	Emit8(e, 0x81);
+	Emit8(e, 0xc0 | (ext << 3) | (dst & 7));
+	Emit32(e, imm);
+}
+
+// shl /4, shr /5
+static void EmitShift(Emitter* e, uint8_t ext, uint8_t dst, uint8_t amount)
+{
+	EmitRex(e, 0, dst, 0);
+	Emit8(e, 0xc1);
+	Emit8(e, 0xc0 | (ext << 3) | (dst & 7));
+	Emit8(e, amount);
+}
+
+static void EmitMovImm(Emitter* e, uint8_t dst, uint32_t imm)
+{
+	EmitRex(e, 0, dst, 0);
+	Emit8(e, 0xb8 + (dst & 7));
+	Emit32(e, imm);
+}
+
+// cmove 44, cmovne 45
+static void EmitCmov(Emitter* e, uint8_t cc, uint8_t dst, uint8_t src)
+{
+	EmitRex(e, dst, src, 0);
+	Emit8(e, 0x0f);
+	Emit8(e, cc);
+	Emit8(e, 0xc0 | ((dst & 7) << 3) | (src & 7));
+}
+
+// movzx r32, byte [rdi + disp]
+static void EmitLoadByte(Emitter* e, uint8_t dst, uint32_t disp)
+{
+	EmitRex(e, dst, RDI, 0);
+	Emit8(e, 0x0f);
+	Emit8(e, 0xb6);
+	Emit8(e, 0x80 | ((dst & 7) << 3) | RDI);
+	Emit32(e, disp);
+}
+
+// mov byte [rdi + disp], r8
+static void EmitStoreByte(Emitter* e, uint8_t src, uint32_t disp)
+{
+	EmitRex(e, src, RDI, 1); // always need a REX prefix to reach sil/bpl
+	Emit8(e, 0x88);
+	Emit8(e, 0x80 | ((src & 7) << 3) | RDI);
+	Emit32(e, disp);
+}
+
+// mov word [rdi + disp], imm16
+static void EmitStoreWordImm(Emitter* e, uint32_t disp, uint16_t imm)
+{
+	Emit8(e, 0x66);
+	Emit8(e, 0xc7);
+	Emit8(e, 0x80 | RDI);
+	Emit32(e, disp);
+	Emit16(e, imm);
+}
+
+// mov word [rdi + disp], dx
+static void EmitStoreWordDx(Emitter* e, uint32_t disp)
+{
+	Emit8(e, 0x66);
+	Emit8(e, 0x89);
+	Emit8(e, 0x80 | (RDX << 3) | RDI);
+	Emit32(e, disp);
+}
+
+static void EmitPush(Emitter* e, uint8_t reg)
+{
+	EmitRex(e, 0, reg, 0);
+	Emit8(e, 0x50 + (reg & 7));
+}
+
+static void EmitPop(Emitter* e, uint8_t reg)
+{
+	EmitRex(e, 0, reg, 0);
+	Emit8(e, 0x58 + (reg & 7));
+}
+
+// ---- translation ----
+
+static uint16_t ReadOpcode(Chip8State* state, uint16_t addr)
+{
+	return (state->memory[addr & 0x0fff] << 8) | state->memory[(addr + 1) & 0x0fff];
+}
+
+// emits the body of one translatable instruction, host[] maps guest V to host registers
+static void TranslateInstruction(Emitter* e, uint16_t opcode, const uint8_t* host)
+{
+	uint8_t vx = host[(opcode >> 8) & 0x0f];
+	uint8_t vy = host[(opcode >> 4) & 0x0f];
+	uint8_t vf = host[15];
+	uint8_t kk = opcode & 0xff;
+
+	switch (opcode >> 12)
+	{
+		case 0x6: // LD Vx, kk
+			EmitMovImm(e, vx, kk);
+			break;
+		case 0x7: // ADD Vx, kk
+			EmitRegImm(e, 0, vx, kk);
+			EmitRegImm(e, 4, vx, 0xff);
+			break;
+		case 0xa: // LD I, nnn
+			EmitStoreWordImm(e, offsetof(Chip8State, I), opcode & 0x0fff);
+			break;
+		case 0x8:
+			switch (opcode & 0x0f)
+			{
+				case 0x0: EmitRegReg(e, 0x89, vx, vy); break; // LD Vx, Vy
+				case 0x1: EmitRegReg(e, 0x09, vx, vy); break; // OR Vx, Vy
+				case 0x2: EmitRegReg(e, 0x21, vx, vy); break; // AND Vx, Vy
+				case 0x3: EmitRegReg(e, 0x31, vx, vy); break; // XOR Vx, Vy
+				case 0x4: // ADD Vx, Vy
+					EmitRegReg(e, 0x89, RAX, vx);
+					EmitRegReg(e, 0x01, RAX, vy);
+					EmitRegReg(e, 0x89, vx, RAX);
+					EmitRegImm(e, 4, vx, 0xff);
+					EmitShift(e, 5, RAX, 8);
+					EmitRegReg(e, 0x89, vf, RAX);
+					break;
+				case 0x5: // SUB Vx, Vy
+				case 0x7: // SUBN Vx, Vy
+					{
+						uint8_t a = (opcode & 0x0f) == 0x5 ? vx : vy;
+						uint8_t b = (opcode & 0x0f) == 0x5 ? vy : vx;
+						EmitRegReg(e, 0x89, RAX, a);
+						EmitRegReg(e, 0x89, RCX, b);
+						EmitRegReg(e, 0x31, RDX, RDX);
+						EmitRegReg(e, 0x39, RAX, RCX);
+						Emit8(e, 0x0f); Emit8(e, 0x93); Emit8(e, 0xc0 | RDX); // setae dl
+						EmitRegReg(e, 0x29, RAX, RCX);
+						EmitRegImm(e, 4, RAX, 0xff);
+						EmitRegReg(e, 0x89, vx, RAX);
+						EmitRegReg(e, 0x89, vf, RDX);
+					}
+					break;
+				case 0x6: // SHR Vx
+					EmitRegReg(e, 0x89, RAX, vx);
+					EmitRegReg(e, 0x89, RDX, RAX);
+					EmitRegImm(e, 4, RDX, 0x1);
+					EmitShift(e, 5, RAX, 1);
+					EmitRegReg(e, 0x89, vx, RAX);
+					EmitRegReg(e, 0x89, vf, RDX);
+					break;
+				case 0xe: // SHL Vx
+					EmitRegReg(e, 0x89, RAX, vx);
+					EmitRegReg(e, 0x89, RDX, RAX);
+					EmitShift(e, 5, RDX, 7);
+					EmitShift(e, 4, RAX, 1);
+					EmitRegImm(e, 4, RAX, 0xff);
+					EmitRegReg(e, 0x89, vx, RAX);
+					EmitRegReg(e, 0x89, vf, RDX);
+					break;
+			}
+			break;
+	}
+}
+
+// emits code leaving the next PC in edx for a block ending with the
+// terminator at addr; if the skip is followed by a JP (the usual loop
+// idiom) the JP is folded in and eax is set to 1 when it gets executed
+static void TranslateEnd(Emitter* e, uint16_t addr, uint16_t opcode, uint16_t folded_jump, const uint8_t* host)
+{
+	uint8_t vx = host[(opcode >> 8) & 0x0f];
+	uint8_t vy = host[(opcode >> 4) & 0x0f];
+
+	if ((opcode >> 12) == 0x1) // JP nnn
+	{
+		EmitMovImm(e, RDX, opcode & 0x0fff);
+		return;
+	}
+
+	// skips: pick between the two possible next instructions without a branch
+	uint8_t skip_if_equal = ((opcode >> 12) == 0x3 || (opcode >> 12) == 0x5);
+	EmitMovImm(e, RDX, folded_jump ? (folded_jump & 0x0fff) : addr + 2);
+	EmitMovImm(e, RCX, addr + 4);
+	if ((opcode >> 12) == 0x3 || (opcode >> 12) == 0x4)
+	{
+		EmitRegImm(e, 7, vx, opcode & 0xff); // cmp Vx, kk
+	}
+	else
+	{
+		EmitRegReg(e, 0x39, vx, vy); // cmp Vx, Vy
+	}
+	EmitCmov(e, skip_if_equal ? 0x44 : 0x45, RDX, RCX);
+
+	if (folded_jump)
+	{
+		Emit8(e, 0x0f); Emit8(e, skip_if_equal ? 0x95 : 0x94); Emit8(e, 0xc0 | RAX); // setne/sete al
+		Emit8(e, 0x0f); Emit8(e, 0xb6); Emit8(e, 0xc0); // movzx eax, al
+	}
+}
+
+static void FlushChip8Jit(Chip8Jit* jit)
+{
+	uint32_t i;
+	for (i = 0; i < 0x1000; i++)
+	{
+		jit->blocks[i].status = BLOCK_UNKNOWN;
+		jit->code_mark[i] = 0;
+	}
+	jit->arena_used = 0;
+}
+
+static Chip8JitBlock* CompileBlock(Chip8Jit* jit, uint16_t start)
+{
+	Chip8State* state = jit->state;
+	Chip8JitBlock* block = &jit->blocks[start];
+
+	// first pass: find where the block ends and which registers it needs
+	uint16_t used = 0, written = 0;
+	uint16_t addr = start;
+	uint16_t end_opcode = 0, folded_jump = 0;
+	int count = 0, has_end = 0;
+	while (count < JIT_MAX_BLOCK_INSTRUCTIONS && addr + 1 <= 0x0fff)
+	{
+		uint16_t opcode = ReadOpcode(state, addr);
+		uint16_t r, w;
+		int kind = ClassifyForJit(opcode, state->quirks, &r, &w);
+		if (kind == JIT_NONE)
+		{
+			break;
+		}
+
+		uint16_t regs = used | r | w;
+		if (__builtin_popcount(regs) > GUEST_POOL_SIZE) // out of host registers, stop here
+		{
+			break;
+		}
+		used = regs;
+		written |= w;
+		count++;
+
+		if (kind == JIT_END)
+		{
+			end_opcode = opcode;
+			has_end = 1;
+			if ((opcode >> 12) != 0x1 && addr + 3 <= 0x0fff && (ReadOpcode(state, addr + 2) >> 12) == 0x1)
+			{
+				folded_jump = ReadOpcode(state, addr + 2);
+			}
+			break;
+		}
+		addr += 2;
+	}
+
+	if (count == 0)
+	{
+		block->status = BLOCK_INTERPRET;
+		return block;
+	}
+
+	if (jit->arena_used + JIT_MAX_BLOCK_CODE > JIT_ARENA_SIZE)
+	{
+		FlushChip8Jit(jit);
+	}
+
+	// assign host registers
+	uint8_t host[16] = { 0 };
+	uint8_t saved[GUEST_POOL_SIZE];
+	int nsaved = 0, next = 0, v;
+	for (v = 0; v < 16; v++)
+	{
+		if (used & (1 << v))
+		{
+			host[v] = guest_pool[next++];
+			if (IsCalleeSaved(host[v]))
+			{
+				saved[nsaved++] = host[v];
+			}
+		}
+	}
+
+	Emitter e = { jit->arena + jit->arena_used };
+	uint8_t* code = e.p;
+	uint32_t v_offset = offsetof(Chip8State, V);
+	int max_count = count + (folded_jump ? 1 : 0);
+
+	int i;
+	for (i = 0; i < nsaved; i++)
+	{
+		EmitPush(&e, saved[i]);
+	}
+	for (v = 0; v < 16; v++)
+	{
+		if (used & (1 << v))
+		{
+			EmitLoadByte(&e, host[v], v_offset + v);
+		}
+	}
+	EmitRegReg(&e, 0x31, R11, R11); // r11d counts executed instructions
+	uint8_t* loop_top = e.p;
+
+	// second pass: translate
+	uint16_t pc = start;
+	for (i = 0; i < count - has_end; i++, pc += 2)
+	{
+		TranslateInstruction(&e, ReadOpcode(state, pc), host);
+	}
+
+	uint8_t* exit_patch[2];
+	int npatches = 0;
+	if (has_end)
+	{
+		TranslateEnd(&e, pc, end_opcode, folded_jump, host);
+		pc += folded_jump ? 4 : 2;
+
+		EmitRegImm(&e, 0, R11, count);
+		EmitRegImm(&e, 5, RSI, count);
+		if (folded_jump)
+		{
+			EmitRegReg(&e, 0x01, R11, RAX);
+			EmitRegReg(&e, 0x29, RSI, RAX);
+		}
+
+		// a block that jumps back to its own start keeps going without leaving
+		// native code, as long as the budget (esi) has room for another pass
+		EmitRegImm(&e, 7, RDX, start);
+		Emit8(&e, 0x0f); Emit8(&e, 0x85); exit_patch[npatches++] = e.p; Emit32(&e, 0); // jne exit
+		EmitRegImm(&e, 7, RSI, max_count);
+		Emit8(&e, 0x0f); Emit8(&e, 0x82); exit_patch[npatches++] = e.p; Emit32(&e, 0); // jb exit
+		Emit8(&e, 0xe9); Emit32(&e, (uint32_t)(loop_top - (e.p + 4))); // jmp loop_top
+	}
+	else
+	{
+		EmitMovImm(&e, RDX, pc);
+		EmitRegImm(&e, 0, R11, count);
+	}
+
+	for (i = 0; i < npatches; i++)
+	{
+		uint32_t rel = e.p - (exit_patch[i] + 4);
+		exit_patch[i][0] = rel & 0xff;
+		exit_patch[i][1] = (rel >> 8) & 0xff;
+		exit_patch[i][2] = (rel >> 16) & 0xff;
+		exit_patch[i][3] = rel >> 24;
+	}
+
+	EmitStoreWordDx(&e, offsetof(Chip8State, PC));
+	for (v = 0; v < 16; v++)
+	{
+		if (written & (1 << v))
+		{
+			EmitStoreByte(&e, host[v], v_offset + v);
+		}
+	}
+	EmitRegReg(&e, 0x89, RAX, R11);
+	for (i = nsaved - 1; i >= 0; i--)
+	{
+		EmitPop(&e, saved[i]);
+	}
+	Emit8(&e, 0xc3); // ret
+
+	jit->arena_used += e.p - code;
+
+	block->code = (Chip8JitCode)code;
+	block->end = pc;
+	block->instructions = max_count;
+	block->status = BLOCK_COMPILED;
+
+	uint16_t a;
+	for (a = start; a < pc; a++)
+	{
+		jit->code_mark[a] = 1;
+	}
+	return block;
+}
+
+Chip8Jit* InitChip8Jit(Chip8State* state)
+{
+	Chip8Jit* jit = calloc(sizeof(Chip8Jit), 1);
+	jit->state = state;
+	jit->quirks = state->quirks;
+	jit->arena = mmap(NULL, JIT_ARENA_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (jit->arena == MAP_FAILED)
+	{
+		free(jit);
+		return NULL;
+	}
+	return jit;
+}
+
+void DeleteChip8Jit(Chip8Jit* jit)
+{
+	munmap(jit->arena, JIT_ARENA_SIZE);
+	free(jit);
+}
+
+void InvalidateChip8Jit(Chip8Jit* jit, uint16_t addr, uint16_t len)
+{
+	uint32_t i;
+	for (i = addr; i < (uint32_t)addr + len; i++)
+	{
+		uint16_t a = i & 0x0fff;
+
+		// an instruction starting here or one byte before may have become translatable
+		if (jit->blocks[a].status == BLOCK_INTERPRET)
+		{
+			jit->blocks[a].status = BLOCK_UNKNOWN;
+		}
+		if (jit->blocks[(a - 1) & 0x0fff].status == BLOCK_INTERPRET)
+		{
+			jit->blocks[(a - 1) & 0x0fff].status = BLOCK_UNKNOWN;
+		}
+
+		if (!jit->code_mark[a])
+		{
+			continue;
+		}
+
+		// rare: a ROM rewrote its own compiled code, drop every block covering the byte
+		// (blocks are never longer than JIT_MAX_BLOCK_INSTRUCTIONS, so only look that far back)
+		uint16_t s = (a >= JIT_MAX_BLOCK_INSTRUCTIONS * 2) ? a - JIT_MAX_BLOCK_INSTRUCTIONS * 2 : 0;
+		for (; s <= a; s++)
+		{
+			if (jit->blocks[s].status == BLOCK_COMPILED && jit->blocks[s].end > a)
+			{
+				jit->blocks[s].status = BLOCK_UNKNOWN;
+			}
+		}
+		jit->code_mark[a] = 0;
+	}
+}
+
+// ends every frame the last step finished, translated code never touches the timers
+// so ticking them afterwards comes out the same as ticking them on the boundary
+static void CatchUpFrames(Chip8Scheduler* sched, Chip8State* state)
+{
+	while (state->frame_cycles >= sched->instructions_per_frame)
+	{
+		uint32_t over = state->frame_cycles - sched->instructions_per_frame;
+		EndChip8Frame(sched, state);
+		state->frame_cycles = over;
+	}
+}
+
+static uint64_t RunJit(Chip8Jit* jit, Chip8Scheduler* sched, uint64_t max_instructions)
+{
+	Chip8State* state = jit->state;
+	uint64_t executed = 0;
+
+	// blocks have the quirks baked in, throw them all away if someone changed them since
+	if (state->quirks != jit->quirks)
+	{
+		FlushChip8Jit(jit);
+		jit->quirks = state->quirks;
+	}
+
+	while (executed < max_instructions)
+	{
+		// the interpreter lets PC run past 0xfff (fetches wrap), blocks only know 12-bit addresses
+		Chip8JitBlock* block = &jit->blocks[state->PC & 0x0fff];
+		if (block->status == BLOCK_UNKNOWN && state->PC <= 0x0fff)
+		{
+			block = CompileBlock(jit, state->PC);
+		}
+
+		if (block->status == BLOCK_COMPILED && state->PC <= 0x0fff && block->instructions <= max_instructions - executed)
+		{
+			uint64_t budget = max_instructions - executed;
+			uint32_t ran = block->code(state, budget > UINT32_MAX ? UINT32_MAX : budget);
+			state->cycles += ran;
+			state->frame_cycles += ran;
+			executed += ran;
+			if (sched)
+			{
+				CatchUpFrames(sched, state);
+			}
+			continue;
+		}
+
+		// interpret a single instruction, then drop any code it overwrote
+		uint16_t opcode = ReadOpcode(state, state->PC);
+		uint16_t target = state->I;
+		uint16_t stored = 0;
+		if ((opcode & 0xf0ff) == 0xf033) // LD B, Vx
+		{
+			stored = 3;
+		}
+		else if ((opcode & 0xf0ff) == 0xf055) // LD [I], Vx
+		{
+			stored = ((opcode >> 8) & 0x0f) + 1;
+		}
+
+		uint8_t before[16];
+		uint16_t i;
+		for (i = 0; i < stored; i++)
+		{
+			before[i] = state->memory[(target + i) & 0x0fff];
+		}
+
+		EmulateChip8Operation(state);
+		executed++;
+		if (sched)
+		{
+			CatchUpFrames(sched, state);
+		}
+
+		if (stored)
+		{
+			// ROMs often store the same bytes over and over, only rewritten ones matter
+			for (i = 0; i < stored; i++)
+			{
+				if (state->memory[(target + i) & 0x0fff] != before[i])
+				{
+					InvalidateChip8Jit(jit, target + i, 1);
+				}
+			}
+		}
+		else if ((opcode & 0xf000) == 0x2000) // CALL pushes the return address
+		{
+			InvalidateChip8Jit(jit, 0xea0 + state->SP, 2);
+		}
+	}
+	return executed;
+}
+
+uint64_t RunChip8Jit(Chip8Jit* jit, uint64_t max_instructions)
+{
+	return RunJit(jit, NULL, max_instructions);
+}
+
+uint64_t RunChip8JitFrames(Chip8Jit* jit, Chip8Scheduler* sched, uint64_t max_instructions)
+{
+	return RunJit(jit, sched, max_instructions);
+}
+
+#else
+
+// no recompiler on this platform, callers fall back on EmulateChip8Operation
+
+Chip8Jit* InitChip8Jit(Chip8State* state)
+{
+	return NULL;
+}
+
+void DeleteChip8Jit(Chip8Jit* jit)
+{
+}
+
+uint64_t RunChip8Jit(Chip8Jit* jit, uint64_t max_instructions)
+{
+	return 0;
+}
+
+uint64_t RunChip8JitFrames(Chip8Jit* jit, Chip8Scheduler* sched, uint64_t max_instructions)
+{
+	return 0;
+}
+
+void InvalidateChip8Jit(Chip8Jit* jit, uint16_t addr, uint16_t len)
+{
+}
+
+#endif
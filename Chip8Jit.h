@@ -0,0 +1,32 @@
+#ifndef CHIP8JIT_H_
+#define CHIP8JIT_H_
+
+#include <stdint.h>
+
+#include "Chip8.h"
+#include "Chip8Scheduler.h"
+
+// Dynamic recompiler: translates straight-line runs of register-only
+// instructions into native x86-64 code and interprets everything else.
+// Only available on x86-64 Linux, InitChip8Jit() returns NULL elsewhere.
+// The state's quirks are baked into translated code, changing them (SetChip8Quirks
+// or loading a snapshot) throws every block away on the next run.
+
+typedef struct Chip8Jit Chip8Jit;
+
+Chip8Jit* InitChip8Jit(Chip8State* state);
+void DeleteChip8Jit(Chip8Jit* jit);
+
+// runs up to max_instructions, returns how many were actually executed
+uint64_t RunChip8Jit(Chip8Jit* jit, uint64_t max_instructions);
+
+// same, but ends sched's frames itself (EndChip8Frame every instructions_per_frame,
+// counted in state->frame_cycles) instead of leaving that to the caller. translated
+// blocks don't look at the timers, so they keep looping straight across frame
+// boundaries and the ticks get caught up after them, meant for unthrottled schedulers
+uint64_t RunChip8JitFrames(Chip8Jit* jit, Chip8Scheduler* sched, uint64_t max_instructions);
+
+// must be called after writing to state->memory from outside the emulator
+void InvalidateChip8Jit(Chip8Jit* jit, uint16_t addr, uint16_t len);
+
+#endif
@@ -0,0 +1,401 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "Chip8.h"
+#include "Chip8Lockstep.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CHIP8_HAVE_X86_SIMD
+#endif
+
+Chip8Lockstep* InitChip8Lockstep(uint32_t count, const uint8_t* rom, uint32_t size)
+{
+	if (!count)
+	{
+		return NULL;
+	}
+
+	Chip8Lockstep* ls = calloc(1, sizeof(Chip8Lockstep));
+	ls->count = count;
+	ls->group_count = (count + CHIP8_LOCKSTEP_WIDTH - 1) / CHIP8_LOCKSTEP_WIDTH;
+	ls->groups = aligned_alloc(32, ls->group_count * sizeof(Chip8LockstepGroup));
+	ls->lanes = aligned_alloc(64, (size_t)count * sizeof(Chip8State));
+	memset(ls->groups, 0, ls->group_count * sizeof(Chip8LockstepGroup));
+
+	uint32_t n;
+	for (n = 0; n < count; n++)
+	{
+		Chip8State* lane = &ls->lanes[n];
+		InitChip8At(lane);
+		if (!LoadChip8Program(lane, rom, size))
+		{
+			DeleteChip8Lockstep(ls);
+			return NULL;
+		}
+		SeedChip8Random(lane, n + 1);
+
+		ls->groups[n / CHIP8_LOCKSTEP_WIDTH].lanes |= 1u << (n % CHIP8_LOCKSTEP_WIDTH);
+		WriteChip8LockstepLane(ls, n);
+	}
+
+#ifdef CHIP8_HAVE_X86_SIMD
+	ls->simd = __builtin_cpu_supports("avx2") != 0;
+#endif
+	return ls;
+}
+
+void DeleteChip8Lockstep(Chip8Lockstep* ls)
+{
+	free(ls->groups);
+	free(ls->lanes);
+	free(ls);
+}
+
+// copies a lane's registers between its group and its own state
+static inline void LoadLane(const Chip8LockstepGroup* g, uint32_t j, Chip8State* lane)
+{
+	uint8_t r;
+	for (r = 0; r < 16; r++)
+	{
+		lane->V[r] = g->V[r][j];
+	}
+	lane->I = g->I[j];
+	lane->PC = g->PC[j];
+	lane->DT = g->DT[j];
+	lane->ST = g->ST[j];
+}
+
+static inline void StoreLane(Chip8LockstepGroup* g, uint32_t j, const Chip8State* lane)
+{
+	uint8_t r;
+	for (r = 0; r < 16; r++)
+	{
+		g->V[r][j] = lane->V[r];
+	}
+	g->I[j] = lane->I;
+	g->PC[j] = lane->PC;
+	g->DT[j] = lane->DT;
+	g->ST[j] = lane->ST;
+}
+
+Chip8State* ReadChip8LockstepLane(Chip8Lockstep* ls, uint32_t n)
+{
+	LoadLane(&ls->groups[n / CHIP8_LOCKSTEP_WIDTH], n % CHIP8_LOCKSTEP_WIDTH, &ls->lanes[n]);
+	return &ls->lanes[n];
+}
+
+void WriteChip8LockstepLane(Chip8Lockstep* ls, uint32_t n)
+{
+	StoreLane(&ls->groups[n / CHIP8_LOCKSTEP_WIDTH], n % CHIP8_LOCKSTEP_WIDTH, &ls->lanes[n]);
+}
+
+static inline void MarkDivergedCode(Chip8LockstepGroup* g, uint16_t addr, uint16_t len)
+{
+	uint16_t i;
+	for (i = 0; i < len; i++)
+	{
+		uint16_t a = (addr + i) & 0x0fff;
+		g->diverged_code[a >> 6] |= 1ULL << (a & 63);
+	}
+}
+
+static inline int IsDivergedCode(const Chip8LockstepGroup* g, uint16_t pc)
+{
+	uint16_t a = pc & 0x0fff;
+	uint16_t b = (pc + 1) & 0x0fff;
+	return ((g->diverged_code[a >> 6] >> (a & 63)) | (g->diverged_code[b >> 6] >> (b & 63))) & 0x1;
+}
+
+// one instruction for one lane through the ordinary interpreter
+static void StepLane(Chip8LockstepGroup* g, uint32_t j, Chip8State* lane)
+{
+	LoadLane(g, j, lane);
+
+	// lanes only ever write memory here, note where so the vector path stops trusting it as code
+	uint16_t opcode = (lane->memory[lane->PC & 0x0fff] << 8) | lane->memory[(lane->PC + 1) & 0x0fff];
+	if ((opcode & 0xf0ff) == 0xf033) // LD B, Vx
+	{
+		MarkDivergedCode(g, lane->I, 3);
+	}
+	else if ((opcode & 0xf0ff) == 0xf055) // LD [I], Vx
+	{
+		MarkDivergedCode(g, lane->I, ((opcode >> 8) & 0x0f) + 1);
+	}
+	else if ((opcode & 0xf000) == 0x2000) // CALL pushes the return address
+	{
+		MarkDivergedCode(g, 0xea0 + (uint8_t)(lane->SP + 2), 2);
+	}
+
+	EmulateChip8Operation(lane);
+	StoreLane(g, j, lane);
+}
+
+#ifdef CHIP8_HAVE_X86_SIMD
+
+// byte mask with 0xff in every lane whose bit is set
+__attribute__((target("avx2")))
+static inline __m256i LaneMask(uint32_t bits)
+{
+	const __m256i spread = _mm256_setr_epi64x(0x0000000000000000LL, 0x0101010101010101LL, 0x0202020202020202LL, 0x0303030303030303LL);
+	const __m256i select = _mm256_set1_epi64x(0x8040201008040201LL);
+	__m256i v = _mm256_shuffle_epi8(_mm256_set1_epi32(bits), spread);
+	return _mm256_cmpeq_epi8(_mm256_and_si256(v, select), select);
+}
+
+// 32 byte lanes become two registers of 16-bit lanes, matching I and PC
+__attribute__((target("avx2")))
+static inline __m256i WidenLo(__m256i v, int sign)
+{
+	return sign ? _mm256_cvtepi8_epi16(_mm256_castsi256_si128(v)) : _mm256_cvtepu8_epi16(_mm256_castsi256_si128(v));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i WidenHi(__m256i v, int sign)
+{
+	return sign ? _mm256_cvtepi8_epi16(_mm256_extracti128_si256(v, 1)) : _mm256_cvtepu8_epi16(_mm256_extracti128_si256(v, 1));
+}
+
+// and back again, for 16-bit lanes holding 0/-1 or small values
+__attribute__((target("avx2")))
+static inline __m256i Narrow(__m256i lo, __m256i hi)
+{
+	return _mm256_permute4x64_epi64(_mm256_packs_epi16(lo, hi), 0xd8);
+}
+
+#define LOAD(p) _mm256_load_si256((const __m256i*)(p))
+#define STORE(p, v) _mm256_store_si256((__m256i*)(p), v)
+#define BLEND_STORE(p, v, m) STORE(p, _mm256_blendv_epi8(LOAD(p), v, m))
+
+// runs one opcode for the lanes in 'bits', returns 0 if it needs the interpreter instead.
+// 'quirks' has every quirk some lane in the group has, those opcodes are left to the interpreter
+__attribute__((target("avx2")))
+static int StepVector(Chip8LockstepGroup* g, uint16_t opcode, uint32_t bits, uint8_t quirks)
+{
+	uint8_t x = (opcode >> 8) & 0x0f;
+	uint8_t y = (opcode >> 4) & 0x0f;
+	uint8_t kk = opcode & 0xff;
+	uint16_t nnn = opcode & 0x0fff;
+
+	__m256i m = LaneMask(bits);
+	__m256i vx = LOAD(g->V[x]);
+	__m256i vy = LOAD(g->V[y]);
+	__m256i one = _mm256_set1_epi8(1);
+	__m256i skip = _mm256_setzero_si256(); // lanes that skip the next instruction
+	__m256i result, flag;
+
+	switch (opcode >> 12)
+	{
+		case 0x1: // JP nnn
+			{
+				__m256i target = _mm256_set1_epi16(nnn);
+				BLEND_STORE(g->PC, target, WidenLo(m, 1));
+				BLEND_STORE(g->PC + 16, target, WidenHi(m, 1));
+				return 1;
+			}
+		case 0x3: skip = _mm256_cmpeq_epi8(vx, _mm256_set1_epi8(kk)); break; // SE Vx, kk
+		case 0x4: skip = _mm256_xor_si256(_mm256_cmpeq_epi8(vx, _mm256_set1_epi8(kk)), _mm256_set1_epi8(-1)); break; // SNE Vx, kk
+		case 0x5: // SE Vx, Vy
+			if (opcode & 0x000f) return 0;
+			skip = _mm256_cmpeq_epi8(vx, vy);
+			break;
+		case 0x9: // SNE Vx, Vy
+			if (opcode & 0x000f) return 0;
+			skip = _mm256_xor_si256(_mm256_cmpeq_epi8(vx, vy), _mm256_set1_epi8(-1));
+			break;
+		case 0x6: BLEND_STORE(g->V[x], _mm256_set1_epi8(kk), m); break; // LD Vx, kk
+		case 0x7: BLEND_STORE(g->V[x], _mm256_add_epi8(vx, _mm256_set1_epi8(kk)), m); break; // ADD Vx, kk
+		case 0x8:
+			switch (opcode & 0x000f)
+			{
+				case 0x0: BLEND_STORE(g->V[x], vy, m); break;
+				case 0x1:
+					if (quirks & CHIP8_QUIRK_VF_RESET) return 0;
+					BLEND_STORE(g->V[x], _mm256_or_si256(vx, vy), m);
+					break;
+				case 0x2:
+					if (quirks & CHIP8_QUIRK_VF_RESET) return 0;
+					BLEND_STORE(g->V[x], _mm256_and_si256(vx, vy), m);
+					break;
+				case 0x3:
+					if (quirks & CHIP8_QUIRK_VF_RESET) return 0;
+					BLEND_STORE(g->V[x], _mm256_xor_si256(vx, vy), m);
+					break;
+				case 0x4: // carry when the saturating add comes out different
+					result = _mm256_add_epi8(vx, vy);
+					flag = _mm256_andnot_si256(_mm256_cmpeq_epi8(result, _mm256_adds_epu8(vx, vy)), one);
+					BLEND_STORE(g->V[x], result, m);
+					BLEND_STORE(g->V[15], flag, m);
+					break;
+				case 0x5: // no borrow when y - x saturates to 0
+					result = _mm256_sub_epi8(vx, vy);
+					flag = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_subs_epu8(vy, vx), _mm256_setzero_si256()), one);
+					BLEND_STORE(g->V[x], result, m);
+					BLEND_STORE(g->V[15], flag, m);
+					break;
+				case 0x7:
+					result = _mm256_sub_epi8(vy, vx);
+					flag = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_subs_epu8(vx, vy), _mm256_setzero_si256()), one);
+					BLEND_STORE(g->V[x], result, m);
+					BLEND_STORE(g->V[15], flag, m);
+					break;
+				case 0x6: // no byte shifts, so shift words and drop what crossed over
+					if (quirks & CHIP8_QUIRK_SHIFT_VY) return 0;
+					result = _mm256_and_si256(_mm256_srli_epi16(vx, 1), _mm256_set1_epi8(0x7f));
+					flag = _mm256_and_si256(vx, one);
+					BLEND_STORE(g->V[x], result, m);
+					BLEND_STORE(g->V[15], flag, m);
+					break;
+				case 0xe:
+					if (quirks & CHIP8_QUIRK_SHIFT_VY) return 0;
+					result = _mm256_add_epi8(vx, vx);
+					flag = _mm256_and_si256(_mm256_srli_epi16(vx, 7), one);
+					BLEND_STORE(g->V[x], result, m);
+					BLEND_STORE(g->V[15], flag, m);
+					break;
+				default:
+					return 0;
+			}
+			break;
+		case 0xa: // LD I, nnn
+			{
+				__m256i target = _mm256_set1_epi16(nnn);
+				BLEND_STORE(g->I, target, WidenLo(m, 1));
+				BLEND_STORE(g->I + 16, target, WidenHi(m, 1));
+			}
+			break;
+		case 0xf:
+			switch (kk)
+			{
+				case 0x07: BLEND_STORE(g->V[x], LOAD(g->DT), m); break; // LD Vx, DT
+				case 0x15: BLEND_STORE(g->DT, vx, m); break; // LD DT, Vx
+				case 0x18: BLEND_STORE(g->ST, vx, m); break; // LD ST, Vx
+				case 0x1e: // ADD I, Vx
+					{
+						__m256i mask12 = _mm256_set1_epi16(0x0fff);
+						__m256i lo = _mm256_add_epi16(LOAD(g->I), WidenLo(vx, 0));
+						__m256i hi = _mm256_add_epi16(LOAD(g->I + 16), WidenHi(vx, 0));
+						flag = _mm256_and_si256(Narrow(_mm256_cmpgt_epi16(lo, mask12), _mm256_cmpgt_epi16(hi, mask12)), one);
+						BLEND_STORE(g->I, _mm256_and_si256(lo, mask12), WidenLo(m, 1));
+						BLEND_STORE(g->I + 16, _mm256_and_si256(hi, mask12), WidenHi(m, 1));
+						BLEND_STORE(g->V[15], flag, m);
+					}
+					break;
+				case 0x29: // LD F, Vx
+					{
+						__m256i digit = _mm256_and_si256(vx, _mm256_set1_epi8(0x0f));
+						__m256i five = _mm256_set1_epi16(5);
+						BLEND_STORE(g->I, _mm256_mullo_epi16(WidenLo(digit, 0), five), WidenLo(m, 1));
+						BLEND_STORE(g->I + 16, _mm256_mullo_epi16(WidenHi(digit, 0), five), WidenHi(m, 1));
+					}
+					break;
+				default:
+					return 0;
+			}
+			break;
+		default:
+			return 0;
+	}
+
+	// PC moves on by 2, or 4 for the lanes that skip
+	__m256i step = _mm256_and_si256(m, _mm256_add_epi8(_mm256_set1_epi8(2), _mm256_and_si256(skip, _mm256_set1_epi8(2))));
+	STORE(g->PC, _mm256_add_epi16(LOAD(g->PC), WidenLo(step, 0)));
+	STORE(g->PC + 16, _mm256_add_epi16(LOAD(g->PC + 16), WidenHi(step, 0)));
+	return 1;
+}
+
+// every lane in the group executes one instruction: lanes sharing a PC go
+// together, starting with the lowest lane that hasn't gone yet
+__attribute__((target("avx2")))
+static void StepGroupAVX2(Chip8LockstepGroup* g, Chip8State* lanes, uint8_t quirks)
+{
+	uint32_t todo = g->lanes;
+	while (todo)
+	{
+		uint32_t leader = __builtin_ctz(todo);
+		uint16_t pc = g->PC[leader];
+
+		__m256i target = _mm256_set1_epi16(pc);
+		__m256i same = Narrow(_mm256_cmpeq_epi16(LOAD(g->PC), target), _mm256_cmpeq_epi16(LOAD(g->PC + 16), target));
+		uint32_t bits = (uint32_t)_mm256_movemask_epi8(same) & todo;
+		todo &= ~bits;
+
+		const uint8_t* code = lanes[leader].memory;
+		uint16_t opcode = (code[pc & 0x0fff] << 8) | code[(pc + 1) & 0x0fff];
+		if (!IsDivergedCode(g, pc) && StepVector(g, opcode, bits, quirks))
+		{
+			continue;
+		}
+
+		while (bits)
+		{
+			uint32_t j = __builtin_ctz(bits);
+			bits &= bits - 1;
+			StepLane(g, j, &lanes[j]);
+		}
+	}
+}
+
+#undef LOAD
+#undef STORE
+#undef BLEND_STORE
+
+#endif
+
+void RunChip8Lockstep(Chip8Lockstep* ls, uint64_t cycles)
+{
+	// a group at a time, so its registers stay in cache for the whole run
+	uint32_t gi;
+	for (gi = 0; gi < ls->group_count; gi++)
+	{
+		Chip8LockstepGroup* g = &ls->groups[gi];
+		Chip8State* lanes = &ls->lanes[gi * CHIP8_LOCKSTEP_WIDTH];
+#ifdef CHIP8_HAVE_X86_SIMD
+		if (ls->simd)
+		{
+			uint8_t quirks = 0; // every quirk any lane in the group has set
+			uint32_t j;
+			for (j = 0; j < CHIP8_LOCKSTEP_WIDTH; j++)
+			{
+				if (g->lanes & (1u << j))
+				{
+					quirks |= lanes[j].quirks;
+				}
+			}
+
+			uint64_t c;
+			for (c = 0; c < cycles; c++)
+			{
+				StepGroupAVX2(g, lanes, quirks);
+			}
+			continue;
+		}
+#endif
+		// without SIMD there's nothing to gain from lockstep, each lane just runs on its own
+		uint32_t todo = g->lanes;
+		while (todo)
+		{
+			uint32_t j = __builtin_ctz(todo);
+			todo &= todo - 1;
+			LoadLane(g, j, &lanes[j]);
+			Chip8Run(&lanes[j], cycles, 0);
+			StoreLane(g, j, &lanes[j]);
+		}
+	}
+	ls->cycles += cycles;
+}
+
+void TickChip8LockstepTimers(Chip8Lockstep* ls)
+{
+	uint32_t gi, j;
+	for (gi = 0; gi < ls->group_count; gi++)
+	{
+		Chip8LockstepGroup* g = &ls->groups[gi];
+		for (j = 0; j < CHIP8_LOCKSTEP_WIDTH; j++) // simple enough for the compiler to vectorize
+		{
+			g->DT[j] -= g->DT[j] > 0;
+			g->ST[j] -= g->ST[j] > 0;
+		}
+	}
+}
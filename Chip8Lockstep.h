@@ -0,0 +1,62 @@
+#ifndef CHIP8LOCKSTEP_H_
+#define CHIP8LOCKSTEP_H_
+
+#include <stdint.h>
+
+#include "Chip8.h"
+
+// Runs lots of instances of the same ROM in lockstep (for fuzzing and searching
+// over inputs). Registers are kept structure-of-arrays style in groups of
+// CHIP8_LOCKSTEP_WIDTH instances, so when a group's PCs agree one AVX2
+// instruction does the work for the whole group. Lanes that went their own way
+// run through EmulateChip8Operation, as does anything touching memory, the
+// display, the stack or the keyboard (and everything, without AVX2).
+
+#define CHIP8_LOCKSTEP_WIDTH 32 // one byte per instance in a 256-bit register
+
+typedef struct Chip8LockstepGroup
+{
+	uint8_t V[16][CHIP8_LOCKSTEP_WIDTH];
+	uint8_t DT[CHIP8_LOCKSTEP_WIDTH];
+	uint8_t ST[CHIP8_LOCKSTEP_WIDTH];
+	uint16_t I[CHIP8_LOCKSTEP_WIDTH];
+	uint16_t PC[CHIP8_LOCKSTEP_WIDTH];
+
+	uint32_t lanes; // bit n set if lane n holds an instance (the last group can be partly empty)
+	uint64_t diverged_code[0x1000 / 64]; // bit per byte of memory that lanes may have written differently
+} __attribute__((aligned(32))) Chip8LockstepGroup;
+
+typedef struct Chip8Lockstep
+{
+	uint32_t count; // instances
+	uint32_t group_count;
+	Chip8LockstepGroup* groups;
+
+	// everything else about an instance (memory, display, keys, stack pointer, rng)
+	// stays in an ordinary state; V, I, PC, DT and ST in there are only current after
+	// ReadChip8LockstepLane
+	Chip8State* lanes;
+
+	// set by InitChip8Lockstep if AVX2 is there, otherwise every lane just runs through
+	// Chip8Run on its own. only change it before the first RunChip8Lockstep
+	int simd;
+	uint64_t cycles; // instructions executed by each instance (the lanes' own counters aren't kept up)
+} Chip8Lockstep;
+
+// 'count' instances of one ROM, instance n gets SeedChip8Random(n + 1).
+// returns NULL if the ROM doesn't fit in memory
+Chip8Lockstep* InitChip8Lockstep(uint32_t count, const uint8_t* rom, uint32_t size);
+void DeleteChip8Lockstep(Chip8Lockstep* ls);
+
+// every instance executes exactly 'cycles' instructions
+void RunChip8Lockstep(Chip8Lockstep* ls, uint64_t cycles);
+
+// TickChip8Timers for every instance
+void TickChip8LockstepTimers(Chip8Lockstep* ls);
+
+// brings instance n's Chip8State up to date and returns it; keys and quirks can be
+// set through it, register changes need WriteChip8LockstepLane to stick
+Chip8State* ReadChip8LockstepLane(Chip8Lockstep* ls, uint32_t n);
+void WriteChip8LockstepLane(Chip8Lockstep* ls, uint32_t n);
+
+#endif
@@ -0,0 +1,72 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "Chip8.h"
+#include "Chip8Pool.h"
+
+struct Chip8Pool
+{
+	Chip8State blank; // what AcquireChip8 copies when it isn't given a template
+	Chip8State* states; // capacity instances back to back
+	uint32_t* free_list; // indices of the unused ones, a stack
+	uint32_t free_count;
+	uint32_t capacity;
+};
+
+Chip8Pool* InitChip8Pool(uint32_t capacity)
+{
+	Chip8Pool* pool = aligned_alloc(64, sizeof(Chip8Pool));
+	if (!pool)
+	{
+		return NULL;
+	}
+	pool->states = aligned_alloc(64, (size_t)capacity * sizeof(Chip8State));
+	pool->free_list = malloc(capacity * sizeof(uint32_t));
+	if (!pool->states || !pool->free_list)
+	{
+		free(pool->states);
+		free(pool->free_list);
+		free(pool);
+		return NULL;
+	}
+
+	InitChip8At(&pool->blank);
+	pool->capacity = capacity;
+	pool->free_count = capacity;
+	uint32_t i;
+	for (i = 0; i < capacity; i++)
+	{
+		pool->states[i].decode_cache = NULL; // all ResetChip8 keeps from what was there before
+		pool->free_list[i] = capacity - 1 - i; // handed out in address order
+	}
+	return pool;
+}
+
+void DeleteChip8Pool(Chip8Pool* pool)
+{
+	uint32_t i;
+	for (i = 0; i < pool->capacity; i++)
+	{
+		free(pool->states[i].decode_cache);
+	}
+	free(pool->states);
+	free(pool->free_list);
+	free(pool);
+}
+
+Chip8State* AcquireChip8(Chip8Pool* pool, const Chip8State* from)
+{
+	if (!pool->free_count)
+	{
+		return NULL;
+	}
+	Chip8State* state = &pool->states[pool->free_list[--pool->free_count]];
+	ResetChip8(state, from ? from : &pool->blank);
+	return state;
+}
+
+void ReleaseChip8(Chip8Pool* pool, Chip8State* state)
+{
+	pool->free_list[pool->free_count++] = state - pool->states;
+}
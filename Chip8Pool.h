@@ -0,0 +1,29 @@
+#ifndef CHIP8POOL_H_
+#define CHIP8POOL_H_
+
+#include <stdint.h>
+
+#include "Chip8.h"
+
+// A fixed number of instances carved out of one allocation, for hosts that go
+// through thousands of short runs. Acquiring and releasing never touch malloc,
+// and a new instance is one memcpy from a template (ResetChip8), so preparing a
+// ROM once and stamping out copies of it is about as cheap as starting gets.
+// A pool isn't thread safe, give each thread its own.
+
+typedef struct Chip8Pool Chip8Pool;
+
+// returns NULL if the storage can't be had
+Chip8Pool* InitChip8Pool(uint32_t capacity);
+
+// frees every instance along with any decode cache one was given
+void DeleteChip8Pool(Chip8Pool* pool);
+
+// an unused instance, started as a copy of 'from' (or as InitChip8 leaves one when
+// 'from' is NULL). NULL once every instance is in use
+Chip8State* AcquireChip8(Chip8Pool* pool, const Chip8State* from);
+
+// hands an instance back; its decode cache stays with it for the next user
+void ReleaseChip8(Chip8Pool* pool, Chip8State* state);
+
+#endif
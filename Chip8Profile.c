@@ -0,0 +1,112 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "Chip8.h"
+#include "Chip8Disassembler.h"
+#include "Chip8Profile.h"
+
+struct Chip8Profile
+{
+	Chip8ProfileCounters counters;
+};
+
+typedef struct HotSpot
+{
+	uint64_t count;
+	uint16_t index; // address or operation class
+} HotSpot;
+
+Chip8Profile* InitChip8Profile(void)
+{
+	Chip8Profile* profile = calloc(1, sizeof(Chip8Profile));
+	profile->counters.draw_gap_min = UINT64_MAX;
+	return profile;
+}
+
+void DeleteChip8Profile(Chip8Profile* profile)
+{
+	free(profile);
+}
+
+void SetChip8Profiling(Chip8Profile* profile, Chip8State* state, int on)
+{
+	state->profile = on ? &profile->counters : NULL;
+}
+
+static int CompareHotSpots(const void* a, const void* b)
+{
+	const HotSpot* x = a;
+	const HotSpot* y = b;
+	if (x->count != y->count)
+	{
+		return x->count < y->count ? 1 : -1; // busiest first
+	}
+	return x->index < y->index ? -1 : 1;
+}
+
+static double Percent(uint64_t part, uint64_t whole)
+{
+	return whole ? 100.0 * part / whole : 0.0;
+}
+
+void ReportChip8Profile(const Chip8Profile* profile, const Chip8State* state, FILE* out, uint32_t hot_spots)
+{
+	const Chip8ProfileCounters* counts = &profile->counters;
+	HotSpot spots[CHIP8_MEMORY_SIZE];
+	uint32_t count = 0;
+	uint32_t i;
+
+	fprintf(out, "profile: %llu instructions\n", (unsigned long long)counts->instructions);
+
+	fprintf(out, "operations:\n");
+	for (i = 0; i < CHIP8_OPERATION_CLASSES; i++)
+	{
+		if (counts->class_counts[i])
+		{
+			spots[count].count = counts->class_counts[i];
+			spots[count].index = i;
+			count++;
+		}
+	}
+	qsort(spots, count, sizeof(HotSpot), CompareHotSpots);
+	for (i = 0; i < count; i++)
+	{
+		fprintf(out, "\t%-10s %12llu %6.2f%%\n", Chip8OperationClassName(spots[i].index),
+			(unsigned long long)spots[i].count, Percent(spots[i].count, counts->instructions));
+	}
+
+	count = 0;
+	for (i = 0; i < CHIP8_MEMORY_SIZE; i++)
+	{
+		if (counts->pc_counts[i])
+		{
+			spots[count].count = counts->pc_counts[i];
+			spots[count].index = i;
+			count++;
+		}
+	}
+	qsort(spots, count, sizeof(HotSpot), CompareHotSpots);
+
+	fprintf(out, "hot spots:\n");
+	for (i = 0; i < count && i < hot_spots; i++)
+	{
+		uint16_t pc = spots[i].index;
+		uint8_t code[2] = { state->memory[pc], state->memory[(pc + 1) & 0x0fff] }; // an opcode at 0xfff wraps
+		fprintf(out, "\t%04x %02x%02x %12llu %6.2f%%  %s\n", pc, code[0], code[1],
+			(unsigned long long)spots[i].count, Percent(spots[i].count, counts->instructions), Chip8Mnemonic((code[0] << 8) | code[1]));
+	}
+
+	if (counts->draws > 1)
+	{
+		fprintf(out, "draws: %llu, %.1f cycles apart on average (min %llu, max %llu)\n",
+			(unsigned long long)counts->draws, (double)counts->draw_gap_total / (counts->draws - 1),
+			(unsigned long long)counts->draw_gap_min, (unsigned long long)counts->draw_gap_max);
+	}
+	else
+	{
+		fprintf(out, "draws: %llu\n", (unsigned long long)counts->draws);
+	}
+	fprintf(out, "key wait: %llu cycles (%.2f%%)\n",
+		(unsigned long long)counts->key_wait_cycles, Percent(counts->key_wait_cycles, counts->instructions));
+}
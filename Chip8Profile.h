@@ -0,0 +1,30 @@
+#ifndef CHIP8PROFILE_H_
+#define CHIP8PROFILE_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "Chip8.h"
+
+// Instruction-level profiling: how often each operation and each address ran,
+// how far apart the Dxyn draws are and how long the ROM sat blocked on Fx0A.
+// While a profile is attached Chip8Run switches to an interpreter core that
+// counts as it dispatches, so profiled runs go at close to full speed and runs
+// that aren't profiled don't pay anything for it.
+
+#define CHIP8_PROFILE_HOT_SPOTS 20 // addresses listed by default
+
+typedef struct Chip8Profile Chip8Profile;
+
+Chip8Profile* InitChip8Profile(void);
+void DeleteChip8Profile(Chip8Profile* profile);
+
+// attaches the profile to state (or detaches it), from then on every Chip8Run on
+// state counts into it. the recompiler's native blocks don't get counted
+void SetChip8Profiling(Chip8Profile* profile, Chip8State* state, int on);
+
+// writes the operation histogram, the 'hot_spots' busiest addresses (disassembled
+// from state's memory as it is now) and the draw and key wait figures
+void ReportChip8Profile(const Chip8Profile* profile, const Chip8State* state, FILE* out, uint32_t hot_spots);
+
+#endif
@@ -0,0 +1,200 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "Chip8.h"
+#include "Chip8Snapshot.h"
+#include "Chip8Rewind.h"
+
+// worst case for the encoding below: changed and unchanged bytes taking turns, every
+// changed one costs a control byte of its own and every unchanged one another
+#define MAX_RECORD_SIZE (CHIP8_SNAPSHOT_SIZE + CHIP8_SNAPSHOT_SIZE / 2 + 2)
+
+// records are laid out as u32 length, payload, u32 length; the trailing length
+// lets us walk back from the newest, the leading one forward from the oldest
+struct Chip8Rewind
+{
+	uint8_t* ring;
+	size_t capacity;
+	size_t head; // where the next record goes
+	size_t used;
+	uint64_t records;
+
+	int have_frame; // cur holds the last pushed frame
+	uint8_t cur[CHIP8_SNAPSHOT_SIZE];
+	uint8_t next[CHIP8_SNAPSHOT_SIZE];
+	uint8_t scratch[MAX_RECORD_SIZE];
+};
+
+Chip8Rewind* InitChip8Rewind(size_t budget)
+{
+	Chip8Rewind* rewind = calloc(1, sizeof(Chip8Rewind));
+	rewind->ring = malloc(budget ? budget : 1);
+	rewind->capacity = budget;
+	return rewind;
+}
+
+void DeleteChip8Rewind(Chip8Rewind* rewind)
+{
+	free(rewind->ring);
+	free(rewind);
+}
+
+// the ring wraps, so copies in and out may come in two pieces
+static void RingWrite(Chip8Rewind* rewind, size_t offset, const void* data, size_t n)
+{
+	offset %= rewind->capacity;
+	size_t first = rewind->capacity - offset < n ? rewind->capacity - offset : n;
+	memcpy(rewind->ring + offset, data, first);
+	memcpy(rewind->ring, (const uint8_t*)data + first, n - first);
+}
+
+static void RingRead(const Chip8Rewind* rewind, size_t offset, void* data, size_t n)
+{
+	offset %= rewind->capacity;
+	size_t first = rewind->capacity - offset < n ? rewind->capacity - offset : n;
+	memcpy(data, rewind->ring + offset, first);
+	memcpy((uint8_t*)data + first, rewind->ring, n - first);
+}
+
+// XOR of a and b as runs: control byte c < 0x80 is followed by c + 1 literal bytes,
+// c >= 0x80 stands for c - 0x7f zero bytes (bytes that didn't change)
+static size_t EncodeXor(const uint8_t* a, const uint8_t* b, size_t n, uint8_t* out)
+{
+	size_t i = 0, o = 0;
+	while (i < n)
+	{
+		size_t run = 0;
+		while (i + run < n && run < 128 && a[i + run] == b[i + run])
+		{
+			run++;
+		}
+		if (run)
+		{
+			out[o++] = 0x80 + run - 1;
+			i += run;
+			continue;
+		}
+
+		size_t control = o++;
+		size_t literal = 0;
+		while (i < n && literal < 128 && a[i] != b[i])
+		{
+			out[o++] = a[i] ^ b[i];
+			i++;
+			literal++;
+		}
+		out[control] = literal - 1;
+	}
+	return o;
+}
+
+static void DecodeXor(uint8_t* dest, const uint8_t* in, size_t len)
+{
+	size_t i = 0, o = 0;
+	while (o < len)
+	{
+		uint8_t c = in[o++];
+		if (c >= 0x80)
+		{
+			i += c - 0x7f;
+			continue;
+		}
+		uint32_t k;
+		for (k = 0; k <= c; k++)
+		{
+			dest[i++] ^= in[o++];
+		}
+	}
+}
+
+static void DropOldest(Chip8Rewind* rewind)
+{
+	uint32_t len;
+	RingRead(rewind, rewind->head + rewind->capacity - rewind->used, &len, 4);
+	rewind->used -= len + 8;
+	rewind->records--;
+}
+
+// snapshot ids are a hash of the contents, they'd change every frame for no reason.
+// frames are loaded back with Chip8LoadTrustedState, which doesn't look at the id
+static void TakeSnapshot(const Chip8State* state, uint8_t* snapshot)
+{
+	Chip8SaveState(state, NULL, snapshot, CHIP8_SNAPSHOT_SIZE);
+	memset(snapshot + 8, 0, 8);
+}
+
+void PushChip8Rewind(Chip8Rewind* rewind, const Chip8State* state)
+{
+	if (!rewind->have_frame)
+	{
+		TakeSnapshot(state, rewind->cur);
+		rewind->have_frame = 1;
+		return;
+	}
+
+	TakeSnapshot(state, rewind->next);
+	uint32_t len = EncodeXor(rewind->next, rewind->cur, CHIP8_SNAPSHOT_SIZE, rewind->scratch);
+	assert(len <= MAX_RECORD_SIZE);
+	memcpy(rewind->cur, rewind->next, CHIP8_SNAPSHOT_SIZE);
+
+	if (len + 8 > rewind->capacity)
+	{
+		rewind->used = 0; // doesn't fit even on its own, history ends here
+		rewind->records = 0;
+		return;
+	}
+	while (rewind->capacity - rewind->used < len + 8)
+	{
+		DropOldest(rewind);
+	}
+
+	RingWrite(rewind, rewind->head, &len, 4);
+	RingWrite(rewind, rewind->head + 4, rewind->scratch, len);
+	RingWrite(rewind, rewind->head + 4 + len, &len, 4);
+	rewind->head = (rewind->head + len + 8) % rewind->capacity;
+	rewind->used += len + 8;
+	rewind->records++;
+}
+
+uint64_t RewindChip8(Chip8Rewind* rewind, Chip8State* state, uint64_t frames)
+{
+	if (!rewind->have_frame)
+	{
+		return 0;
+	}
+
+	// each record XORed over a frame gives the one before it, newest first. work on a
+	// copy, the ring only gives the records up once the state has taken the frame
+	memcpy(rewind->next, rewind->cur, CHIP8_SNAPSHOT_SIZE);
+	size_t head = rewind->head;
+	size_t used = rewind->used;
+	uint64_t done;
+	for (done = 0; done < frames && done < rewind->records; done++)
+	{
+		uint32_t len;
+		size_t end = head + rewind->capacity;
+		RingRead(rewind, end - 4, &len, 4);
+		RingRead(rewind, end - 4 - len, rewind->scratch, len);
+		DecodeXor(rewind->next, rewind->scratch, len);
+
+		head = (end - len - 8) % rewind->capacity;
+		used -= len + 8;
+	}
+
+	if (!Chip8LoadTrustedState(state, rewind->next, CHIP8_SNAPSHOT_SIZE))
+	{
+		return 0;
+	}
+	memcpy(rewind->cur, rewind->next, CHIP8_SNAPSHOT_SIZE);
+	rewind->head = head;
+	rewind->used = used;
+	rewind->records -= done;
+	return done;
+}
+
+uint64_t Chip8RewindFrames(const Chip8Rewind* rewind)
+{
+	return rewind->records;
+}
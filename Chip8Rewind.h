@@ -0,0 +1,34 @@
+#ifndef CHIP8REWIND_H_
+#define CHIP8REWIND_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "Chip8.h"
+
+// Rewind history: a ring buffer with one record per frame, each holding what it
+// takes to get from that frame back to the one before (the two snapshots XORed
+// together, then run-length encoded, so unchanged bytes cost next to nothing).
+// Stepping back n frames undoes the n newest records. Once the ring is full the
+// oldest frames are dropped to make room.
+
+#define CHIP8_REWIND_DEFAULT_BUDGET (4 * 1024 * 1024) // around 10 minutes at 60 frames per second for most ROMs
+
+typedef struct Chip8Rewind Chip8Rewind;
+
+// budget is how many bytes of history to keep
+Chip8Rewind* InitChip8Rewind(size_t budget);
+void DeleteChip8Rewind(Chip8Rewind* rewind);
+
+// records the state at the end of a frame, call it once per frame
+void PushChip8Rewind(Chip8Rewind* rewind, const Chip8State* state);
+
+// puts state back to how it was 'frames' pushes before the last one, forgetting the
+// frames in between. returns how many frames it actually went back (history runs out),
+// 0 if the frame wouldn't load, in which case state and history are left as they were
+uint64_t RewindChip8(Chip8Rewind* rewind, Chip8State* state, uint64_t frames);
+
+// how far back RewindChip8 can go right now
+uint64_t Chip8RewindFrames(const Chip8Rewind* rewind);
+
+#endif
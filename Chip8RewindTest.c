@@ -0,0 +1,86 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "Chip8.h"
+#include "Chip8Scheduler.h"
+#include "Chip8Rewind.h"
+
+#define FRAMES 100
+#define REWIND_FRAMES 50
+
+// counts V0 up, stores it to memory and loads it into the delay timer over and over,
+// so registers, memory and timers all change every frame
+static const uint8_t program[] =
+{
+	0xA3, 0x00, // I = 0x300
+	0x70, 0x01, // V0 += 1
+	0xF0, 0x55, // [I] = V0
+	0xF0, 0x15, // DT = V0
+	0x12, 0x00, // jump 0x200
+};
+
+static Chip8State* StartChip8(void)
+{
+	Chip8State* state = InitChip8();
+	LoadChip8Program(state, program, sizeof(program));
+	return state;
+}
+
+static void RunFrame(Chip8State* state)
+{
+	Chip8Run(state, CHIP8_DEFAULT_INSTRUCTIONS_PER_FRAME, 0);
+	TickChip8Timers(state);
+	state->frame_cycles = 0;
+}
+
+// Runs a ROM for a while recording every frame, rewinds part of the way and checks
+// the state against a run that simply stopped there. Exits with 0 if they match
+int main(void)
+{
+	Chip8State* rewound = StartChip8();
+	Chip8Rewind* rewind = InitChip8Rewind(CHIP8_REWIND_DEFAULT_BUDGET);
+	PushChip8Rewind(rewind, rewound);
+
+	int i;
+	for (i = 0; i < FRAMES; i++)
+	{
+		RunFrame(rewound);
+		PushChip8Rewind(rewind, rewound);
+	}
+
+	uint64_t done = RewindChip8(rewind, rewound, REWIND_FRAMES);
+	DeleteChip8Rewind(rewind);
+
+	Chip8State* expected = StartChip8();
+	for (i = 0; i < FRAMES - REWIND_FRAMES; i++)
+	{
+		RunFrame(expected);
+	}
+
+	int failed = 0;
+	if (done != REWIND_FRAMES)
+	{
+		printf("ERROR: rewound %llu frames instead of %d\n", (unsigned long long)done, REWIND_FRAMES);
+		failed = 1;
+	}
+	if (rewound->PC != expected->PC || rewound->V[0] != expected->V[0] || rewound->DT != expected->DT)
+	{
+		printf("ERROR: rewound to PC:%04x V0:%02x DT:%02x, expected PC:%04x V0:%02x DT:%02x\n",
+			rewound->PC, rewound->V[0], rewound->DT, expected->PC, expected->V[0], expected->DT);
+		failed = 1;
+	}
+	if (HashChip8State(rewound) != HashChip8State(expected))
+	{
+		printf("ERROR: rewound state differs from a run of %d frames\n", FRAMES - REWIND_FRAMES);
+		failed = 1;
+	}
+
+	if (!failed)
+	{
+		printf("rewind: OK\n");
+	}
+	DeleteChip8(rewound);
+	DeleteChip8(expected);
+	return failed;
+}
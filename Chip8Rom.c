@@ -0,0 +1,159 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "Chip8.h"
+#include "Chip8Rom.h"
+
+#define CACHE_BUCKETS 256 // power of two, indexed by the low bits of the hash
+
+// a cached ROM and the instance copies of it start from
+typedef struct CachedRom
+{
+	Chip8State initial;
+	Chip8Rom rom;
+	struct CachedRom* next; // same bucket
+} CachedRom;
+
+struct Chip8RomCache
+{
+	pthread_mutex_t lock;
+	CachedRom* buckets[CACHE_BUCKETS];
+};
+
+static const uint8_t empty_rom[1]; // what an empty file "maps" to, mmap won't take a length of 0
+
+static uint64_t HashRom(const uint8_t* data, uint32_t size)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	uint32_t i;
+	for (i = 0; i < size; i++)
+	{
+		hash = (hash ^ data[i]) * 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+int MapChip8Rom(const char* path, Chip8Rom* rom)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+	{
+		return 0;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size > CHIP8_MAX_ROM_SIZE)
+	{
+		close(fd);
+		return 0;
+	}
+
+	const uint8_t* data = empty_rom;
+	if (st.st_size)
+	{
+		void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map == MAP_FAILED)
+		{
+			close(fd);
+			return 0;
+		}
+		data = map;
+	}
+	close(fd); // the mapping stays valid without it
+
+	rom->data = data;
+	rom->size = st.st_size;
+	rom->hash = HashRom(data, rom->size);
+	rom->initial = NULL;
+	return 1;
+}
+
+void UnmapChip8Rom(Chip8Rom* rom)
+{
+	if (rom->size)
+	{
+		munmap((void*)rom->data, rom->size);
+	}
+	rom->data = NULL;
+	rom->size = 0;
+}
+
+Chip8RomCache* InitChip8RomCache(void)
+{
+	Chip8RomCache* cache = calloc(1, sizeof(Chip8RomCache));
+	if (!cache)
+	{
+		return NULL;
+	}
+	pthread_mutex_init(&cache->lock, NULL);
+	return cache;
+}
+
+void DeleteChip8RomCache(Chip8RomCache* cache)
+{
+	uint32_t i;
+	for (i = 0; i < CACHE_BUCKETS; i++)
+	{
+		CachedRom* entry = cache->buckets[i];
+		while (entry)
+		{
+			CachedRom* next = entry->next;
+			UnmapChip8Rom(&entry->rom);
+			free(entry);
+			entry = next;
+		}
+	}
+	pthread_mutex_destroy(&cache->lock);
+	free(cache);
+}
+
+const Chip8Rom* OpenChip8Rom(Chip8RomCache* cache, const char* path)
+{
+	// mapped and hashed outside the lock, the lookup is all that has to wait
+	Chip8Rom rom;
+	if (!MapChip8Rom(path, &rom))
+	{
+		return NULL;
+	}
+
+	pthread_mutex_lock(&cache->lock);
+	CachedRom** bucket = &cache->buckets[rom.hash & (CACHE_BUCKETS - 1)];
+	CachedRom* entry;
+	for (entry = *bucket; entry; entry = entry->next)
+	{
+		if (entry->rom.hash == rom.hash && entry->rom.size == rom.size && !memcmp(entry->rom.data, rom.data, rom.size))
+		{
+			break;
+		}
+	}
+
+	if (entry)
+	{
+		UnmapChip8Rom(&rom); // seen it before, under this path or another
+	}
+	else
+	{
+		entry = aligned_alloc(64, sizeof(CachedRom)); // a Chip8State has to be
+		if (!entry)
+		{
+			pthread_mutex_unlock(&cache->lock);
+			UnmapChip8Rom(&rom);
+			return NULL;
+		}
+		InitChip8At(&entry->initial);
+		LoadChip8Program(&entry->initial, rom.data, rom.size);
+
+		entry->rom = rom;
+		entry->rom.initial = &entry->initial;
+		entry->next = *bucket;
+		*bucket = entry;
+	}
+	pthread_mutex_unlock(&cache->lock);
+	return &entry->rom;
+}
@@ -0,0 +1,44 @@
+#ifndef CHIP8ROM_H_
+#define CHIP8ROM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "Chip8.h"
+
+// ROM files are mapped read-only rather than read, and checked against
+// CHIP8_MAX_ROM_SIZE before anything gets copied anywhere.
+//
+// A Chip8RomCache keeps every ROM it has opened mapped, keyed by a hash of its
+// contents, so the same ROM under any number of paths is only mapped and
+// prepared once. Each cached ROM comes with a fresh instance that already has
+// it loaded, which new instances start from with a single memcpy (ResetChip8,
+// or AcquireChip8 from a pool). A ROM mapped on its own loads like any other
+// program, LoadChip8Program(state, rom.data, rom.size).
+
+typedef struct Chip8Rom
+{
+	const uint8_t* data; // the mapped file
+	uint32_t size;
+	uint64_t hash; // FNV-1a of the contents
+	const Chip8State* initial; // InitChip8 plus the ROM, only set for ROMs from a cache
+} Chip8Rom;
+
+typedef struct Chip8RomCache Chip8RomCache;
+
+// maps a ROM file on its own, returns 0 if it can't be read or is bigger than CHIP8_MAX_ROM_SIZE
+int MapChip8Rom(const char* path, Chip8Rom* rom);
+void UnmapChip8Rom(Chip8Rom* rom);
+
+// NULL if there's no memory for it
+Chip8RomCache* InitChip8RomCache(void);
+
+// unmaps everything, every Chip8Rom the cache handed out goes with it
+void DeleteChip8RomCache(Chip8RomCache* cache);
+
+// the cached copy of a ROM file, mapping it the first time its contents are seen.
+// NULL if it can't be read, is too large or there's no memory to cache it. safe to
+// call from several threads
+const Chip8Rom* OpenChip8Rom(Chip8RomCache* cache, const char* path);
+
+#endif
@@ -0,0 +1,93 @@
+#include <stdint.h>
+#include <time.h>
+#include <errno.h>
+
+#include "Chip8.h"
+#include "Chip8Scheduler.h"
+
+#define NSEC_PER_SEC 1000000000LL
+#define MAX_FRAMES_BEHIND 5 // give up catching up after this, instead of running flat out
+
+// wall-clock time frame 'frame' is due, worked out from the epoch so rounding never accumulates
+static struct timespec FrameDeadline(const Chip8Scheduler* sched, uint64_t frame)
+{
+	int64_t ns = (int64_t)((frame - sched->epoch_frame) * NSEC_PER_SEC / CHIP8_FRAMES_PER_SECOND);
+	struct timespec t = sched->epoch;
+	t.tv_sec += ns / NSEC_PER_SEC;
+	t.tv_nsec += ns % NSEC_PER_SEC;
+	if (t.tv_nsec >= NSEC_PER_SEC)
+	{
+		t.tv_nsec -= NSEC_PER_SEC;
+		t.tv_sec++;
+	}
+	return t;
+}
+
+void InitChip8Scheduler(Chip8Scheduler* sched, uint32_t instructions_per_frame, int throttled)
+{
+	sched->instructions_per_frame = instructions_per_frame;
+	sched->throttled = throttled;
+	sched->frames = 0;
+	sched->epoch_frame = 0;
+	clock_gettime(CLOCK_MONOTONIC, &sched->epoch);
+}
+
+void EndChip8Frame(Chip8Scheduler* sched, Chip8State* state)
+{
+	TickChip8Timers(state);
+	state->frame_cycles = 0;
+	WaitChip8Frame(sched);
+}
+
+void WaitChip8Frame(Chip8Scheduler* sched)
+{
+	sched->frames++;
+
+	if (!sched->throttled)
+	{
+		return;
+	}
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	struct timespec deadline = FrameDeadline(sched, sched->frames);
+	int64_t late = (now.tv_sec - deadline.tv_sec) * NSEC_PER_SEC + (now.tv_nsec - deadline.tv_nsec);
+
+	if (late > MAX_FRAMES_BEHIND * NSEC_PER_SEC / CHIP8_FRAMES_PER_SECOND)
+	{
+		// host stalled for a while, start counting again from here instead of racing to catch up
+		sched->epoch = now;
+		sched->epoch_frame = sched->frames;
+		return;
+	}
+
+	// absolute deadlines, so oversleeping one frame doesn't push back all the others
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR)
+	{
+	}
+}
+
+void StepChip8Frame(Chip8Scheduler* sched, Chip8State* state)
+{
+	if (state->frame_cycles >= sched->instructions_per_frame)
+	{
+		return;
+	}
+
+	uint32_t left = sched->instructions_per_frame - state->frame_cycles;
+	Chip8RunResult result = Chip8Run(state, left, CHIP8_STOP_KEY_WAIT | CHIP8_STOP_EXIT);
+	if (result.reason)
+	{
+		// a ROM blocked on Fx0A would just spin there until the keys change, which they
+		// don't mid-frame, so count those cycles as spent without running them
+		// (and one that's run 00FD is never going anywhere again)
+		state->cycles += left - result.cycles;
+		state->frame_cycles += left - result.cycles;
+	}
+}
+
+void RunChip8Frame(Chip8Scheduler* sched, Chip8State* state)
+{
+	StepChip8Frame(sched, state);
+	EndChip8Frame(sched, state);
+}
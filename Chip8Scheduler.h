@@ -0,0 +1,44 @@
+#ifndef CHIP8SCHEDULER_H_
+#define CHIP8SCHEDULER_H_
+
+#include <stdint.h>
+#include <time.h>
+
+#include "Chip8.h"
+
+// Splits emulation into 60Hz frames: a fixed number of instructions per
+// frame, then DT/ST tick once. Throttled schedulers sleep until the next
+// frame boundary on the monotonic clock, unthrottled ones never sleep so
+// timers advance in emulated time only and runs are fully deterministic.
+
+#define CHIP8_FRAMES_PER_SECOND 60
+#define CHIP8_DEFAULT_INSTRUCTIONS_PER_FRAME 10 // 600Hz cpu
+
+typedef struct Chip8Scheduler
+{
+	uint32_t instructions_per_frame;
+	int throttled;
+	uint64_t frames; // frames completed so far
+
+	// frame n is due at epoch + (n - epoch_frame) / 60 seconds (throttled only)
+	struct timespec epoch;
+	uint64_t epoch_frame;
+} Chip8Scheduler;
+
+void InitChip8Scheduler(Chip8Scheduler* sched, uint32_t instructions_per_frame, int throttled);
+
+// ticks the timers, resets state->frame_cycles, then waits for the frame boundary
+// if throttled; call it after running sched->instructions_per_frame instructions
+void EndChip8Frame(Chip8Scheduler* sched, Chip8State* state);
+
+// just the waiting part of EndChip8Frame, for frames where the emulator doesn't run (rewinding)
+void WaitChip8Frame(Chip8Scheduler* sched);
+
+// runs what's left of the frame with Chip8Run, without ending it. a ROM blocked on
+// Fx0A skips the rest, cycle counts come out the same as if it had spun there
+void StepChip8Frame(Chip8Scheduler* sched, Chip8State* state);
+
+// StepChip8Frame then EndChip8Frame
+void RunChip8Frame(Chip8Scheduler* sched, Chip8State* state);
+
+#endif
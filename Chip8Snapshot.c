@@ -0,0 +1,285 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "Chip8.h"
+#include "Chip8Snapshot.h"
+
+#define FLAG_DELTA 0x0001
+
+// register block offsets
+#define REG_V 0
+#define REG_I 16
+#define REG_PC 18
+#define REG_SP 20
+#define REG_DT 21
+#define REG_ST 22
+#define REG_WAITING 23
+#define REG_QUIRKS 24
+#define REG_HIRES 25 // 26..27 unused
+#define REG_K 28
+#define REG_K_PREV 44
+#define REG_RNG 60
+#define REG_CYCLES 64
+#define REG_CYCLES_PER_FRAME 72
+#define REG_FRAME_CYCLES 76
+#define REG_RPL 80
+
+// spelled out byte by byte so snapshots move between hosts
+static inline void Put16(uint8_t* p, uint16_t v) { p[0] = v; p[1] = v >> 8; }
+static inline void Put32(uint8_t* p, uint32_t v) { Put16(p, v); Put16(p + 2, v >> 16); }
+static inline void Put64(uint8_t* p, uint64_t v) { Put32(p, v); Put32(p + 4, v >> 32); }
+static inline uint16_t Get16(const uint8_t* p) { return p[0] | (p[1] << 8); }
+static inline uint32_t Get32(const uint8_t* p) { return Get16(p) | ((uint32_t)Get16(p + 2) << 16); }
+static inline uint64_t Get64(const uint8_t* p) { return Get32(p) | ((uint64_t)Get32(p + 4) << 32); }
+
+static void PutRegisters(const Chip8State* state, uint8_t* regs)
+{
+	memset(regs, 0, CHIP8_SNAPSHOT_REGS_SIZE);
+	memcpy(regs + REG_V, state->V, 16);
+	Put16(regs + REG_I, state->I);
+	Put16(regs + REG_PC, state->PC);
+	regs[REG_SP] = state->SP;
+	regs[REG_DT] = state->DT;
+	regs[REG_ST] = state->ST;
+	regs[REG_WAITING] = state->waiting_for_key_press;
+	regs[REG_QUIRKS] = state->quirks;
+	regs[REG_HIRES] = state->hires;
+	memcpy(regs + REG_K, state->K, 16);
+	memcpy(regs + REG_K_PREV, state->K_prev, 16);
+	Put32(regs + REG_RNG, state->rng);
+	Put64(regs + REG_CYCLES, state->cycles);
+	Put32(regs + REG_CYCLES_PER_FRAME, state->cycles_per_frame);
+	Put32(regs + REG_FRAME_CYCLES, state->frame_cycles);
+	memcpy(regs + REG_RPL, state->rpl, 16);
+}
+
+static void GetRegisters(Chip8State* state, const uint8_t* regs)
+{
+	memcpy(state->V, regs + REG_V, 16);
+	state->I = Get16(regs + REG_I);
+	state->PC = Get16(regs + REG_PC);
+	state->SP = regs[REG_SP];
+	state->DT = regs[REG_DT];
+	state->ST = regs[REG_ST];
+	state->waiting_for_key_press = regs[REG_WAITING];
+	state->quirks = regs[REG_QUIRKS];
+	state->hires = regs[REG_HIRES];
+	memcpy(state->K, regs + REG_K, 16);
+	memcpy(state->K_prev, regs + REG_K_PREV, 16);
+	state->rng = Get32(regs + REG_RNG);
+	state->cycles = Get64(regs + REG_CYCLES);
+	state->cycles_per_frame = Get32(regs + REG_CYCLES_PER_FRAME);
+	state->frame_cycles = Get32(regs + REG_FRAME_CYCLES);
+	memcpy(state->rpl, regs + REG_RPL, 16);
+}
+
+// display rows are stored after memory, as if they were more of it, 128x64 rows after those
+static inline void PutDisplay(const Chip8State* state, uint8_t* image)
+{
+	uint32_t row;
+	for (row = 0; row < CHIP8_DISPLAY_HEIGHT; row++)
+	{
+		Put64(image + row * 8, state->display[row]);
+	}
+	image += CHIP8_DISPLAY_HEIGHT * 8;
+	for (row = 0; row < CHIP8_HIRES_HEIGHT; row++)
+	{
+		Put64(image + row * 16, state->hires_display[row][0]);
+		Put64(image + row * 16 + 8, state->hires_display[row][1]);
+	}
+}
+
+static inline void GetDisplay(Chip8State* state, const uint8_t* image)
+{
+	uint32_t row;
+	for (row = 0; row < CHIP8_DISPLAY_HEIGHT; row++)
+	{
+		state->display[row] = Get64(image + row * 8);
+	}
+	image += CHIP8_DISPLAY_HEIGHT * 8;
+	for (row = 0; row < CHIP8_HIRES_HEIGHT; row++)
+	{
+		state->hires_display[row][0] = Get64(image + row * 16);
+		state->hires_display[row][1] = Get64(image + row * 16 + 8);
+	}
+}
+
+static uint64_t HashBytes(const uint8_t* p, size_t n)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL; // FNV-1a
+	size_t i;
+	for (i = 0; i < n; i++)
+	{
+		hash = (hash ^ p[i]) * 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+static void PutHeader(uint8_t* header, uint16_t flags, uint64_t id, uint32_t size)
+{
+	memcpy(header, "C8SS", 4);
+	Put16(header + 4, CHIP8_SNAPSHOT_VERSION);
+	Put16(header + 6, flags);
+	Put64(header + 8, id);
+	Put32(header + 16, size);
+	Put32(header + 20, 0);
+}
+
+static int CheckHeader(const uint8_t* buffer, size_t size)
+{
+	return size >= CHIP8_SNAPSHOT_HEADER_SIZE + CHIP8_SNAPSHOT_REGS_SIZE &&
+		memcmp(buffer, "C8SS", 4) == 0 &&
+		Get16(buffer + 4) == CHIP8_SNAPSHOT_VERSION &&
+		Get32(buffer + 16) == size;
+}
+
+// a full snapshot whose contents still hash to its id
+static int CheckFull(const uint8_t* buffer)
+{
+	return CheckHeader(buffer, CHIP8_SNAPSHOT_SIZE) && !(Get16(buffer + 6) & FLAG_DELTA) &&
+		HashBytes(buffer + CHIP8_SNAPSHOT_HEADER_SIZE, CHIP8_SNAPSHOT_SIZE - CHIP8_SNAPSHOT_HEADER_SIZE) == Get64(buffer + 8);
+}
+
+static int CheckFullLayout(const uint8_t* buffer)
+{
+	return CheckHeader(buffer, CHIP8_SNAPSHOT_SIZE) && !(Get16(buffer + 6) & FLAG_DELTA);
+}
+
+size_t Chip8SaveState(const Chip8State* state, const uint8_t* base, uint8_t* buffer, size_t size)
+{
+	uint8_t* regs = buffer + CHIP8_SNAPSHOT_HEADER_SIZE;
+	uint8_t* body = regs + CHIP8_SNAPSHOT_REGS_SIZE;
+
+	if (!base)
+	{
+		if (size < CHIP8_SNAPSHOT_SIZE)
+		{
+			return 0;
+		}
+		PutRegisters(state, regs);
+		memcpy(body, state->memory, CHIP8_MEMORY_SIZE);
+		PutDisplay(state, body + CHIP8_MEMORY_SIZE);
+
+		uint64_t id = HashBytes(regs, CHIP8_SNAPSHOT_SIZE - CHIP8_SNAPSHOT_HEADER_SIZE);
+		PutHeader(buffer, 0, id, CHIP8_SNAPSHOT_SIZE);
+		return CHIP8_SNAPSHOT_SIZE;
+	}
+
+	if (!CheckHeader(base, CHIP8_SNAPSHOT_SIZE) || (Get16(base + 6) & FLAG_DELTA))
+	{
+		return 0;
+	}
+	if (size < CHIP8_SNAPSHOT_HEADER_SIZE + CHIP8_SNAPSHOT_REGS_SIZE + 16)
+	{
+		return 0;
+	}
+
+	// display rows go through Put64 so they compare against the base byte for byte
+	uint8_t display[CHIP8_SNAPSHOT_DISPLAY_SIZE];
+	PutDisplay(state, display);
+	const uint8_t* base_image = base + CHIP8_SNAPSHOT_HEADER_SIZE + CHIP8_SNAPSHOT_REGS_SIZE;
+
+	uint64_t changed[2] = { 0, 0 };
+	uint8_t* out = body + 16;
+	uint32_t page;
+	for (page = 0; page < CHIP8_SNAPSHOT_PAGES; page++)
+	{
+		uint32_t offset = page * CHIP8_SNAPSHOT_PAGE_SIZE;
+		const uint8_t* current = offset < CHIP8_MEMORY_SIZE ? state->memory + offset : display + (offset - CHIP8_MEMORY_SIZE);
+		if (memcmp(current, base_image + offset, CHIP8_SNAPSHOT_PAGE_SIZE) == 0)
+		{
+			continue;
+		}
+		if ((size_t)(out + CHIP8_SNAPSHOT_PAGE_SIZE - buffer) > size)
+		{
+			return 0;
+		}
+		memcpy(out, current, CHIP8_SNAPSHOT_PAGE_SIZE);
+		out += CHIP8_SNAPSHOT_PAGE_SIZE;
+		changed[page >> 6] |= 1ULL << (page & 63);
+	}
+
+	PutRegisters(state, regs);
+	Put64(body, changed[0]);
+	Put64(body + 8, changed[1]);
+	PutHeader(buffer, FLAG_DELTA, Get64(base + 8), out - buffer);
+	return out - buffer;
+}
+
+static int LoadState(Chip8State* state, const uint8_t* base, const uint8_t* buffer, size_t size, int check_id)
+{
+	if (!CheckHeader(buffer, size))
+	{
+		return 0;
+	}
+
+	const uint8_t* regs = buffer + CHIP8_SNAPSHOT_HEADER_SIZE;
+	const uint8_t* body = regs + CHIP8_SNAPSHOT_REGS_SIZE;
+
+	if (!(Get16(buffer + 6) & FLAG_DELTA))
+	{
+		if (size != CHIP8_SNAPSHOT_SIZE || !(check_id ? CheckFull(buffer) : CheckFullLayout(buffer)))
+		{
+			return 0;
+		}
+		memcpy(state->memory, body, CHIP8_MEMORY_SIZE);
+		GetDisplay(state, body + CHIP8_MEMORY_SIZE);
+	}
+	else
+	{
+		// check everything before touching the state
+		if (!base || !CheckFullLayout(base) ||
+			Get64(base + 8) != Get64(buffer + 8) || size < CHIP8_SNAPSHOT_HEADER_SIZE + CHIP8_SNAPSHOT_REGS_SIZE + 16)
+		{
+			return 0;
+		}
+		uint64_t changed[2] = { Get64(body), Get64(body + 8) };
+		if (changed[1] >> (CHIP8_SNAPSHOT_PAGES - 64) ||
+			size != CHIP8_SNAPSHOT_HEADER_SIZE + CHIP8_SNAPSHOT_REGS_SIZE + 16 +
+				(size_t)(__builtin_popcountll(changed[0]) + __builtin_popcountll(changed[1])) * CHIP8_SNAPSHOT_PAGE_SIZE)
+		{
+			return 0;
+		}
+
+		// start from the base, then lay the changed pages over it
+		const uint8_t* base_image = base + CHIP8_SNAPSHOT_HEADER_SIZE + CHIP8_SNAPSHOT_REGS_SIZE;
+		memcpy(state->memory, base_image, CHIP8_MEMORY_SIZE);
+		uint8_t display[CHIP8_SNAPSHOT_DISPLAY_SIZE];
+		memcpy(display, base_image + CHIP8_MEMORY_SIZE, sizeof(display));
+
+		const uint8_t* in = body + 16;
+		uint32_t page;
+		for (page = 0; page < CHIP8_SNAPSHOT_PAGES; page++)
+		{
+			if (!((changed[page >> 6] >> (page & 63)) & 0x1))
+			{
+				continue;
+			}
+			uint32_t offset = page * CHIP8_SNAPSHOT_PAGE_SIZE;
+			uint8_t* dest = offset < CHIP8_MEMORY_SIZE ? state->memory + offset : display + (offset - CHIP8_MEMORY_SIZE);
+			memcpy(dest, in, CHIP8_SNAPSHOT_PAGE_SIZE);
+			in += CHIP8_SNAPSHOT_PAGE_SIZE;
+		}
+		GetDisplay(state, display);
+	}
+
+	GetRegisters(state, regs);
+	state->stop_flags = 0;
+	InvalidateChip8Code(state, 0, CHIP8_MEMORY_SIZE);
+	return 1;
+}
+
+int Chip8CheckState(const uint8_t* buffer, size_t size)
+{
+	return size == CHIP8_SNAPSHOT_SIZE && CheckFull(buffer);
+}
+
+int Chip8LoadState(Chip8State* state, const uint8_t* base, const uint8_t* buffer, size_t size)
+{
+	return LoadState(state, base, buffer, size, 1);
+}
+
+int Chip8LoadTrustedState(Chip8State* state, const uint8_t* buffer, size_t size)
+{
+	return LoadState(state, NULL, buffer, size, 0);
+}
@@ -0,0 +1,54 @@
+#ifndef CHIP8SNAPSHOT_H_
+#define CHIP8SNAPSHOT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "Chip8.h"
+
+// Save states: a versioned, fixed-layout binary snapshot of everything a ROM
+// can observe (registers, keys, timers, memory, display, rng, cycle counters,
+// and the SUPER-CHIP mode, user flags and 128x64 display).
+// Host-side settings (decode cache, breakpoints) aren't part of it.
+//
+// layout, all little-endian:
+//	header		magic "C8SS", u16 version, u16 flags, u64 id, u32 total size, u32 reserved
+//	registers	CHIP8_SNAPSHOT_REGS_SIZE bytes, see Chip8Snapshot.c
+//	full:		memory (4096 bytes), the display rows (256 bytes) then the 128x64 rows (1024 bytes)
+//	delta:		u64[2] bitmap of changed 64-byte pages of all that, then those pages
+//
+// a full snapshot's id is a hash of its contents (checked on load), a delta's id is
+// the id of the full snapshot it was taken against. a delta's own pages aren't hashed,
+// only its layout gets checked, and neither is its base, see Chip8CheckState
+
+#define CHIP8_SNAPSHOT_VERSION 2 // 2 added SUPER-CHIP
+#define CHIP8_SNAPSHOT_PAGE_SIZE 64
+
+#define CHIP8_SNAPSHOT_HEADER_SIZE 24
+#define CHIP8_SNAPSHOT_REGS_SIZE 96
+#define CHIP8_SNAPSHOT_DISPLAY_SIZE (CHIP8_DISPLAY_HEIGHT * 8 + CHIP8_HIRES_HEIGHT * 16)
+#define CHIP8_SNAPSHOT_IMAGE_SIZE (CHIP8_MEMORY_SIZE + CHIP8_SNAPSHOT_DISPLAY_SIZE)
+#define CHIP8_SNAPSHOT_PAGES (CHIP8_SNAPSHOT_IMAGE_SIZE / CHIP8_SNAPSHOT_PAGE_SIZE)
+
+// size of a full snapshot, and the most a delta can take
+#define CHIP8_SNAPSHOT_SIZE (CHIP8_SNAPSHOT_HEADER_SIZE + CHIP8_SNAPSHOT_REGS_SIZE + CHIP8_SNAPSHOT_IMAGE_SIZE)
+#define CHIP8_SNAPSHOT_MAX_DELTA_SIZE (CHIP8_SNAPSHOT_HEADER_SIZE + CHIP8_SNAPSHOT_REGS_SIZE + 16 + CHIP8_SNAPSHOT_IMAGE_SIZE)
+
+// writes a snapshot of state into buffer and returns its size, or 0 if it didn't fit.
+// with a base (a full snapshot) only the pages that changed since it are stored
+size_t Chip8SaveState(const Chip8State* state, const uint8_t* base, uint8_t* buffer, size_t size);
+
+// restores a snapshot, deltas need the full snapshot they were taken against.
+// returns 0 (leaving state alone) if the snapshot is damaged, from another version
+// or doesn't match the base's id. a JIT on the state needs InvalidateChip8Jit afterwards
+int Chip8LoadState(Chip8State* state, const uint8_t* base, const uint8_t* buffer, size_t size);
+
+// nonzero if buffer is an intact full snapshot. a base gets many deltas applied to it,
+// so it's checked once with this when it comes in (from a file, say) instead of on every load
+int Chip8CheckState(const uint8_t* buffer, size_t size);
+
+// same for a full snapshot that never left the process, minus the id check, so the
+// id can be anything (rewind zeroes it). the layout still gets checked
+int Chip8LoadTrustedState(Chip8State* state, const uint8_t* buffer, size_t size);
+
+#endif
@@ -0,0 +1,61 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "Chip8HashTrace.h"
+
+// Compares two golden traces and reports the first frame where they disagree.
+// Exits with 0 if they match, 1 if they don't and 2 if either can't be read
+int main(int argc, char** argv)
+{
+	if (argc != 3)
+	{
+		printf("USAGE: tracediff [expected trace] [actual trace]\n");
+		exit(2);
+	}
+
+	uint64_t* expected;
+	uint64_t* actual;
+	uint64_t expected_frames, actual_frames;
+	uint32_t expected_ipf, actual_ipf;
+
+	if (!LoadChip8HashTrace(argv[1], &expected, &expected_frames, &expected_ipf))
+	{
+		printf("ERROR: \"%s\" is not a frame hash trace\n", argv[1]);
+		exit(2);
+	}
+	if (!LoadChip8HashTrace(argv[2], &actual, &actual_frames, &actual_ipf))
+	{
+		printf("ERROR: \"%s\" is not a frame hash trace\n", argv[2]);
+		exit(2);
+	}
+
+	if (expected_ipf != actual_ipf)
+	{
+		printf("WARNING: traces were taken at %u and %u instructions per frame\n", expected_ipf, actual_ipf);
+	}
+
+	uint64_t frames = expected_frames < actual_frames ? expected_frames : actual_frames;
+	uint64_t n;
+	for (n = 0; n < frames; n++)
+	{
+		if (expected[n] != actual[n])
+		{
+			printf("first divergence at frame %llu: expected %016llx, got %016llx\n",
+				(unsigned long long)n, (unsigned long long)expected[n], (unsigned long long)actual[n]);
+			exit(1);
+		}
+	}
+
+	if (expected_frames != actual_frames)
+	{
+		printf("traces agree for %llu frames, then one ends (%llu vs %llu frames)\n",
+			(unsigned long long)frames, (unsigned long long)expected_frames, (unsigned long long)actual_frames);
+		exit(1);
+	}
+
+	printf("identical: %llu frames\n", (unsigned long long)frames);
+	free(expected);
+	free(actual);
+	return 0;
+}
@@ -0,0 +1,46 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "Chip8.h"
+#include "Chip8Disassembler.h"
+#include "Chip8Tracer.h"
+
+// Prints an execution trace written with -t, one instruction per line:
+// cycle, PC, opcode, mnemonic, then I and V0..VF as they were before it ran
+int main(int argc, char** argv)
+{
+	if (argc != 2)
+	{
+		printf("USAGE: tracedump [execution trace]\n");
+		exit(1);
+	}
+
+	FILE* f = fopen(argv[1], "rb");
+	if (!f)
+	{
+		printf("ERROR: Could not open \"%s\"\n", argv[1]);
+		exit(1);
+	}
+	if (!ReadChip8TraceHeader(f))
+	{
+		printf("ERROR: \"%s\" is not an execution trace\n", argv[1]);
+		fclose(f);
+		exit(1);
+	}
+
+	Chip8TraceEntry entry;
+	while (ReadChip8TraceEntry(f, &entry))
+	{
+		printf("%10llu %04x %04x %-16s I:%03x V:", (unsigned long long)entry.cycle, entry.PC, entry.opcode, Chip8Mnemonic(entry.opcode), entry.I);
+		int i;
+		for (i = 0; i < 16; i++)
+		{
+			printf("%02x", entry.V[i]);
+		}
+		printf("\n");
+	}
+
+	fclose(f);
+	return 0;
+}
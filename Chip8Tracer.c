@@ -0,0 +1,174 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "Chip8.h"
+#include "Chip8Tracer.h"
+
+#define WRITE_BATCH 4096 // entries encoded and written at a time
+#define IDLE_SLEEP_NS 1000000 // how long the writer naps when the ring is empty
+
+struct Chip8Tracer
+{
+	Chip8TraceRing ring;
+	Chip8State* state; // being traced right now, NULL when off
+	FILE* file;
+	pthread_t thread;
+	atomic_int stopping;
+	int failed; // only touched by the writer until it's joined
+	uint8_t buffer[WRITE_BATCH * CHIP8_TRACE_ENTRY_SIZE];
+};
+
+static void PutU16(uint8_t* p, uint16_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+}
+
+static void PutU64(uint8_t* p, uint64_t v)
+{
+	int i;
+	for (i = 0; i < 8; i++)
+	{
+		p[i] = v >> (8 * i);
+	}
+}
+
+static void EncodeEntry(uint8_t* p, const Chip8TraceEntry* entry)
+{
+	PutU64(p, entry->cycle);
+	PutU16(p + 8, entry->PC);
+	PutU16(p + 10, entry->opcode);
+	PutU16(p + 12, entry->I);
+	PutU16(p + 14, 0);
+	memcpy(p + 16, entry->V, 16);
+}
+
+static void* TraceWriterMain(void* arg)
+{
+	Chip8Tracer* tracer = arg;
+	Chip8TraceRing* ring = &tracer->ring;
+	for (;;)
+	{
+		// checked before head, so everything pushed before stopping was set still gets written
+		int stopping = atomic_load(&tracer->stopping);
+		uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+		uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+		if (head == tail)
+		{
+			if (stopping)
+			{
+				break;
+			}
+			struct timespec nap = { 0, IDLE_SLEEP_NS };
+			nanosleep(&nap, NULL);
+			continue;
+		}
+
+		uint64_t n = head - tail;
+		if (n > WRITE_BATCH)
+		{
+			n = WRITE_BATCH;
+		}
+		uint64_t i;
+		for (i = 0; i < n; i++)
+		{
+			EncodeEntry(tracer->buffer + i * CHIP8_TRACE_ENTRY_SIZE, &ring->entries[(tail + i) & ring->mask]);
+		}
+		atomic_store_explicit(&ring->tail, tail + n, memory_order_release); // hand the slots back before the slow part
+
+		if (!tracer->failed && fwrite(tracer->buffer, CHIP8_TRACE_ENTRY_SIZE, n, tracer->file) != n)
+		{
+			tracer->failed = 1;
+		}
+	}
+	return NULL;
+}
+
+Chip8Tracer* InitChip8Tracer(const char* path)
+{
+	Chip8Tracer* tracer = aligned_alloc(64, sizeof(Chip8Tracer)); // the ring's head and tail get a cache line each
+	if (!tracer)
+	{
+		return NULL;
+	}
+	memset(tracer, 0, sizeof(Chip8Tracer));
+	tracer->ring.entries = malloc(CHIP8_TRACE_RING_ENTRIES * sizeof(Chip8TraceEntry));
+	tracer->ring.mask = CHIP8_TRACE_RING_ENTRIES - 1;
+	tracer->file = fopen(path, "wb");
+
+	uint8_t header[CHIP8_TRACE_HEADER_SIZE] = { 'C', '8', 'T', 'R', CHIP8_TRACE_VERSION, 0, 0, 0 };
+	if (!tracer->ring.entries || !tracer->file ||
+		fwrite(header, 1, CHIP8_TRACE_HEADER_SIZE, tracer->file) != CHIP8_TRACE_HEADER_SIZE ||
+		pthread_create(&tracer->thread, NULL, TraceWriterMain, tracer) != 0)
+	{
+		if (tracer->file)
+		{
+			fclose(tracer->file);
+		}
+		free(tracer->ring.entries);
+		free(tracer);
+		return NULL;
+	}
+	return tracer;
+}
+
+int DeleteChip8Tracer(Chip8Tracer* tracer)
+{
+	if (tracer->state)
+	{
+		SetChip8Tracing(tracer, tracer->state, 0);
+	}
+	atomic_store(&tracer->stopping, 1);
+	pthread_join(tracer->thread, NULL);
+
+	int ok = !tracer->failed && !ferror(tracer->file);
+	ok = (fclose(tracer->file) == 0) && ok;
+	free(tracer->ring.entries);
+	free(tracer);
+	return ok;
+}
+
+void SetChip8Tracing(Chip8Tracer* tracer, Chip8State* state, int on)
+{
+	state->trace = on ? &tracer->ring : NULL;
+	tracer->state = on ? state : NULL;
+}
+
+int Chip8Tracing(const Chip8Tracer* tracer)
+{
+	return tracer->state != NULL;
+}
+
+int ReadChip8TraceHeader(FILE* f)
+{
+	uint8_t header[CHIP8_TRACE_HEADER_SIZE];
+	return fread(header, 1, CHIP8_TRACE_HEADER_SIZE, f) == CHIP8_TRACE_HEADER_SIZE &&
+		memcmp(header, "C8TR", 4) == 0 && header[4] == CHIP8_TRACE_VERSION;
+}
+
+int ReadChip8TraceEntry(FILE* f, Chip8TraceEntry* entry)
+{
+	uint8_t p[CHIP8_TRACE_ENTRY_SIZE];
+	if (fread(p, 1, CHIP8_TRACE_ENTRY_SIZE, f) != CHIP8_TRACE_ENTRY_SIZE)
+	{
+		return 0;
+	}
+
+	entry->cycle = 0;
+	int i;
+	for (i = 0; i < 8; i++)
+	{
+		entry->cycle |= (uint64_t)p[i] << (8 * i);
+	}
+	entry->PC = p[8] | (p[9] << 8);
+	entry->opcode = p[10] | (p[11] << 8);
+	entry->I = p[12] | (p[13] << 8);
+	entry->unused = 0;
+	memcpy(entry->V, p + 16, 16);
+	return 1;
+}
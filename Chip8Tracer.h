@@ -0,0 +1,40 @@
+#ifndef CHIP8TRACER_H_
+#define CHIP8TRACER_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "Chip8.h"
+
+// Execution tracing: while it's on, the interpreter drops a Chip8TraceEntry for
+// every instruction into a ring buffer and a background thread writes them out,
+// so the emulator never waits on formatting or the disk (unless the writer falls
+// a whole ring behind, then it waits rather than lose entries).
+// The file is "C8TR", a version byte and 3 unused bytes, then 32 bytes per entry:
+// u64 cycle, u16 PC, u16 opcode, u16 I, u16 unused and V0..VF, all little-endian.
+// tracedump prints one back with the instructions disassembled.
+
+#define CHIP8_TRACE_VERSION 1
+#define CHIP8_TRACE_HEADER_SIZE 8
+#define CHIP8_TRACE_ENTRY_SIZE 32
+#define CHIP8_TRACE_RING_ENTRIES (1 << 16) // 2MB, about 0.3ms of unthrottled emulation
+
+typedef struct Chip8Tracer Chip8Tracer;
+
+// creates the file and starts the writer thread with tracing off, NULL on failure
+Chip8Tracer* InitChip8Tracer(const char* path);
+
+// turns tracing off, writes out whatever's left and closes the file.
+// returns 0 if any of it failed to write
+int DeleteChip8Tracer(Chip8Tracer* tracer);
+
+// turns tracing on or off for state (one state per tracer), from its next run on.
+// only call it from the thread that runs state
+void SetChip8Tracing(Chip8Tracer* tracer, Chip8State* state, int on);
+int Chip8Tracing(const Chip8Tracer* tracer);
+
+// reading a trace back: returns 0 if it isn't one, or once the entries run out
+int ReadChip8TraceHeader(FILE* f);
+int ReadChip8TraceEntry(FILE* f, Chip8TraceEntry* entry);
+
+#endif